@@ -0,0 +1,965 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <future>
+#include <queue>
+#include <unordered_map>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <loonutil/util.h>
+#include <loonutil/simpleHelp.h>
+#include <loonutil/threadPool.h>
+#include <loonutil/manyFileWriter.h>
+#include <riginvutil/bam.h>
+#include <riginvutil/bamIndex.h>
+#include <riginvutil/paf.h>
+#include <riginvutil/briefAlignment.h>
+
+using namespace std;
+
+/*==================== typedef and declarations ====================*/
+typedef unsigned long long ULL;
+class RefAlns;
+class ExtractChunk;
+class RefOutput;
+class Region;
+
+/*==================== command line args ====================*/
+char* bam_file;             // or the PAF file with `paf_input`
+string basedir;             // <working_dir>/intermediate_results
+size_t n_threads = 1;
+size_t cache_size = 1048576;// Hold <= this number of bytes for each file before flushing to the disk
+size_t max_nfiles = 512;    // maximum number of files open at the same time
+size_t memory_budget = 268435456;   // maximum number of bytes held for all the files
+bool write_mk_file = false;
+bool binary_output = false; // write `<id>.bin` in the binary brief alignment format instead of `<id>.txt`
+bool compress_output = false;   // varint encode the blocks of the binary output
+bool use_index = false;     // extract the regions located by the BAM index in parallel
+ULL slice_length = 20000000;// with `use_index`, references longer than this are extracted in slices of this length
+bool sort_output = false;   // save `<id>.sorted.txt` or `<id>.sorted.bin` instead of the unsorted file
+size_t sort_memory = 1073741824;    // with `sort_output`, spill the runs to the disk when they take more than this number of bytes
+bool paf_input = false;     // the input is a PAF file instead of a BAM file
+bool append_mode = false;   // merge the sorted alignments into those of the working directory. Implies `sort_output`
+
+/*==================== global variables ====================*/
+vector<RefOutput> ref_outputs;
+unique_ptr<loon::ManyFileWriter> out_files;
+size_t run_bytes = 0;       // bytes of the runs held by `ref_outputs` for `sort_output`
+vector<int32_t> ref_order;  // reference IDs in the order of their first alignment
+riginv::ReadDict read_dict; // read IDs of the binary output, in the order of the first alignment of each read
+riginv::BamIndex bam_index;
+unordered_map<string, int32_t> paf_ref_ids;     // with `paf_input`, reference IDs in the order of their first alignment
+
+/*==================== class RefAlns ====================*/
+// Brief alignments of one reference extracted from a chunk.
+// Formatted as `text` for the text output, or kept as records for the binary or the sorted output.
+// The references of a PAF file are only known by their names, until the chunk is saved.
+class RefAlns
+{
+public:
+    int32_t ref_id;
+    string ref_name;            // only for `paf_input`
+    ULL ref_len;
+    string text;
+    vector<riginv::BriefAln> alns;
+    string names;               // concatenated read names of `alns`
+    vector<size_t> name_ends;
+};
+
+/*==================== functions ====================*/
+
+// false if the record has no brief alignment
+bool to_brief_aln(const riginv::BamRecord& rec, size_t n_refs, riginv::BriefAln& aln)
+{
+    // N.B. the bam file generated by bwa-mem could have reference_id == -1. Skip such alignments
+    if(rec.ref_id < 0 || static_cast<size_t>(rec.ref_id) >= n_refs)
+        return false;
+    // unmapped alignments don't have a reference end
+    if(!rec.has_reference_end())
+        return false;
+    aln.ref_start = rec.pos;
+    aln.ref_end = rec.pos + rec.reference_length();
+    aln.qry_start = rec.query_alignment_start();
+    aln.qry_end = rec.query_alignment_end();
+    aln.qry_len = rec.l_seq;
+    aln.mapq = rec.mapq;
+    aln.is_reverse = (rec.flag & riginv::BamRecord::FLAG_REVERSE) != 0;
+    return true;
+}
+
+// The query coordinates of a PAF record are on the forward strand of the query, while those of
+// a BAM record are on the strand aligned to the reference, i.e., as pysam reports them.
+bool to_brief_aln(const riginv::PafRecord& rec, riginv::BriefAln& aln)
+{
+    if(!rec.is_mapped())
+        return false;
+    aln.ref_start = rec.ref_start;
+    aln.ref_end = rec.ref_end;
+    aln.qry_start = rec.is_reverse ? rec.qry_len - rec.qry_end : rec.qry_start;
+    aln.qry_end = rec.is_reverse ? rec.qry_len - rec.qry_start : rec.qry_end;
+    aln.qry_len = rec.qry_len;
+    aln.mapq = rec.mapq;
+    aln.is_reverse = rec.is_reverse;
+    return true;
+}
+
+/*==================== class ExtractChunk ====================*/
+class ExtractChunk
+{
+public:
+    string raw;                 // raw BAM records, or the lines of the PAF file
+    vector<RefAlns> refs;       // in the order of the first alignment of each reference
+    future<void> done;
+private:
+    void add(RefAlns& ref_alns, const riginv::BriefAln& aln, const char* qname, size_t qname_len);
+    void extract_paf();
+public:
+    void extract(size_t n_refs);
+};
+
+void ExtractChunk::add(RefAlns& ref_alns, const riginv::BriefAln& aln, const char* qname, size_t qname_len)
+{
+    if(binary_output || sort_output)
+    {
+        ref_alns.alns.push_back( aln );
+        ref_alns.names.append(qname, qname_len);
+        ref_alns.name_ends.push_back( ref_alns.names.size() );
+    }
+    else
+        aln.append_text(ref_alns.text, qname, qname_len);
+}
+
+void ExtractChunk::extract_paf()
+{
+    unordered_map<string, size_t> ref_index;
+    string ref_name;
+    size_t last_refs = 0;
+    riginv::PafRecord rec;
+    riginv::BriefAln aln;
+
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    while(p < end)
+    {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        if(newline == NULL)
+            newline = end;
+        const char* line = p;
+        p = newline + 1;
+        if(newline == line || *line == '#')
+            continue;
+        rec.parse(line, newline - line);
+        if(!to_brief_aln(rec, aln))
+            continue;
+
+        if(refs.empty() || refs[last_refs].ref_name.compare(0, string::npos, rec.tname, rec.tname_len) != 0)
+        {
+            ref_name.assign(rec.tname, rec.tname_len);
+            unordered_map<string, size_t>::iterator it = ref_index.find( ref_name );
+            if(it == ref_index.end())
+            {
+                it = ref_index.insert( make_pair(ref_name, refs.size()) ).first;
+                refs.push_back( RefAlns() );
+                refs.back().ref_name = ref_name;
+                refs.back().ref_len = rec.ref_len;
+            }
+            last_refs = it->second;
+        }
+        add(refs[last_refs], aln, rec.qname, rec.qname_len);
+    }
+    raw.clear();
+    raw.shrink_to_fit();
+}
+
+void ExtractChunk::extract(size_t n_refs)
+{
+    if(paf_input)
+    {
+        extract_paf();
+        return;
+    }
+    unordered_map<int32_t, size_t> ref_index;
+    int32_t last_ref = -1;
+    RefAlns* last_refs = NULL;
+    riginv::BriefAln aln;
+
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    while(p < end)
+    {
+        uint32_t block_size;
+        memcpy(&block_size, p, 4);
+        riginv::BamRecord rec(p + 4, block_size);
+        p += block_size + 4;
+
+        if(!to_brief_aln(rec, n_refs, aln))
+            continue;
+
+        if(rec.ref_id != last_ref)
+        {
+            unordered_map<int32_t, size_t>::iterator it = ref_index.find( rec.ref_id );
+            if(it == ref_index.end())
+            {
+                it = ref_index.insert( make_pair(rec.ref_id, refs.size()) ).first;
+                refs.push_back( RefAlns() );
+                refs.back().ref_id = rec.ref_id;
+            }
+            last_ref = rec.ref_id;
+            last_refs = &refs[ it->second ];
+        }
+        add(*last_refs, aln, rec.qname, rec.qname_len);
+    }
+    raw.clear();
+    raw.shrink_to_fit();
+}
+
+/*==================== class RefOutput ====================*/
+// Output of `<id>.txt` or `<id>.bin`, buffered by `out_files`.
+// With `sort_output`, the alignments are held as a run instead, which is sorted and spilled
+// to `<id>.run<k>.bin` when the runs of all the references take too much memory. The runs
+// are merged into `<id>.sorted.txt` or `<id>.sorted.bin` by finish_sorted().
+class RefOutput
+{
+public:
+    string fname;
+    size_t file;                // handle in `out_files`
+    string buffer;              // encoded bytes, before they are passed to `out_files`
+    unique_ptr<riginv::BriefAlnEncoder> encoder;   // only for the binary output
+
+    vector<riginv::BriefAln> run;   // not spilled yet, in the order of the BAM file
+    string names;                   // read names of `run` for the text output
+    vector<size_t> name_ends;
+    vector<string> run_fnames;      // spilled runs, in the order of the BAM file
+private:
+    void write_run(riginv::BriefAlnWriter& writer, bool with_names) const;
+    void merge_runs();
+public:
+    void write(const RefAlns& refs);
+    void finish();
+    void spill();
+    void finish_sorted();
+    size_t held_bytes() const;      //!< bytes held by `run`
+};
+
+void RefOutput::write(const RefAlns& refs)
+{
+    if(sort_output)
+    {
+        size_t before = held_bytes();
+        size_t name_start = 0;
+        for(size_t i = 0; i < refs.alns.size(); ++i)
+        {
+            run.push_back( refs.alns[i] );
+            if(binary_output)
+                run.back().read_id = read_dict.add(refs.names.data() + name_start, refs.name_ends[i] - name_start);
+            else
+            {
+                names.append(refs.names, name_start, refs.name_ends[i] - name_start);
+                name_ends.push_back( names.size() );
+            }
+            name_start = refs.name_ends[i];
+        }
+        run_bytes += held_bytes() - before;
+        return;
+    }
+    if(binary_output)
+    {
+        size_t name_start = 0;
+        riginv::BriefAln aln;
+        for(size_t i = 0; i < refs.alns.size(); ++i)
+        {
+            aln = refs.alns[i];
+            aln.read_id = read_dict.add(refs.names.data() + name_start, refs.name_ends[i] - name_start);
+            encoder->add(aln, buffer);
+            name_start = refs.name_ends[i];
+        }
+        out_files->write(file, buffer);
+        buffer.clear();
+    }
+    else
+        out_files->write(file, refs.text);
+}
+
+void RefOutput::finish()
+{
+    if(binary_output)
+    {
+        encoder->finish(buffer);
+        out_files->write(file, buffer);
+        buffer.clear();
+    }
+    out_files->close(file);
+}
+
+size_t RefOutput::held_bytes() const
+{
+    return run.size() * sizeof(riginv::BriefAln) + names.size() + name_ends.size() * sizeof(size_t);
+}
+
+// Write `run` in the order of BriefAln::operator<. Equal alignments keep the order of the BAM file
+void RefOutput::write_run(riginv::BriefAlnWriter& writer, bool with_names) const
+{
+    vector<size_t> order(run.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    const vector<riginv::BriefAln>& alns = run;
+    stable_sort(order.begin(), order.end(), [&alns](size_t a, size_t b){ return alns[a] < alns[b]; });
+    for(vector<size_t>::const_iterator it = order.begin(); it != order.end(); ++it)
+    {
+        if(!with_names)
+        {
+            writer.write( run[*it] );
+            continue;
+        }
+        size_t name_start = *it == 0 ? 0 : name_ends[*it - 1];
+        writer.write(run[*it], names.data() + name_start, name_ends[*it] - name_start);
+    }
+}
+
+void RefOutput::spill()
+{
+    string run_fname = fname.substr(0, fname.rfind(".sorted")) + ".run" + to_string(run_fnames.size()) + ".bin";
+    // the runs of the text output keep the read names
+    riginv::BriefAlnWriter writer(run_fname, true, binary_output, compress_output);
+    write_run(writer, !binary_output);
+    writer.close();
+    run_fnames.push_back( run_fname );
+    run_bytes -= held_bytes();
+    vector<riginv::BriefAln>().swap(run);
+    string().swap(names);
+    vector<size_t>().swap(name_ends);
+}
+
+// Head of a run in the k-way merge
+class RunHead
+{
+public:
+    riginv::BriefAln aln;
+    size_t run;
+public:
+    // the smallest alignment of the earliest run is on the top of the heap
+    bool operator<(const RunHead& rhs) const
+    {
+        if(rhs.aln < aln)   return true;
+        if(aln < rhs.aln)   return false;
+        return run > rhs.run;
+    }
+};
+
+void RefOutput::merge_runs()
+{
+    vector<unique_ptr<riginv::BriefAlnReader> > readers;
+    priority_queue<RunHead> heap;
+    RunHead head;
+    for(size_t i = 0; i < run_fnames.size(); ++i)
+    {
+        readers.push_back( unique_ptr<riginv::BriefAlnReader>(new riginv::BriefAlnReader(run_fnames[i])) );
+        head.run = i;
+        if(readers[i]->next( head.aln ))
+            heap.push( head );
+    }
+    riginv::BriefAlnWriter writer(fname, binary_output, binary_output, compress_output);
+    while(!heap.empty())
+    {
+        head = heap.top();
+        heap.pop();
+        if(binary_output)
+            writer.write( head.aln );
+        else
+            writer.write(head.aln, readers[head.run]->read_name( head.aln.read_id ));
+        if(readers[head.run]->next( head.aln ))
+            heap.push( head );
+    }
+    writer.close();
+    readers.clear();
+    for(vector<string>::const_iterator it = run_fnames.begin(); it != run_fnames.end(); ++it)
+        remove( it->c_str() );
+}
+
+void RefOutput::finish_sorted()
+{
+    if(run_fnames.empty())
+    {
+        riginv::BriefAlnWriter writer(fname, binary_output, binary_output, compress_output);
+        write_run(writer, !binary_output);
+        writer.close();
+        return;
+    }
+    if(!run.empty())
+        spill();
+    merge_runs();
+}
+
+/*==================== class Region ====================*/
+// Slice [start, end) of a reference, extracted by one task into its own part file.
+// The BAM file is sorted (it has an index), so the alignments are read from the offset
+// given by the index until the first alignment after the slice.
+class Region
+{
+public:
+    int32_t ref_id;
+    ULL start, end;
+    string fname;                   // part file
+    ULL n_alns;
+    vector<unsigned int> id_map;    // read IDs of the part file -> `read_dict` for the binary output
+public:
+    void extract(size_t n_refs);
+};
+
+void Region::extract(size_t n_refs)
+{
+    riginv::BamReader reader(bam_file);
+    reader.seek( bam_index.offset_of(ref_id, start) );
+    riginv::BriefAlnWriter writer;  // only opened if there is an alignment
+    riginv::BriefAln aln;
+    string chunk;
+    bool finished = false;
+    n_alns = 0;
+    while(!finished && reader.next_chunk( chunk ))
+    {
+        const char* p = chunk.data();
+        const char* chunk_end = p + chunk.size();
+        while(p < chunk_end)
+        {
+            uint32_t block_size;
+            memcpy(&block_size, p, 4);
+            riginv::BamRecord rec(p + 4, block_size);
+            p += block_size + 4;
+
+            if(rec.ref_id != ref_id)
+            {// reference_id == -1 (unsigned) comes after all the references
+                finished = static_cast<uint32_t>(rec.ref_id) > static_cast<uint32_t>(ref_id);
+                if(finished)    break;
+                continue;
+            }
+            if(rec.pos < 0 || static_cast<ULL>(rec.pos) < start)
+                continue;
+            if(static_cast<ULL>(rec.pos) >= end)
+            {
+                finished = true;
+                break;
+            }
+            if(!to_brief_aln(rec, n_refs, aln))
+                continue;
+            if(n_alns++ == 0)
+                writer.open(fname, binary_output, false, compress_output);
+            writer.write(aln, rec.qname, rec.qname_len);
+        }
+    }
+    if(n_alns > 0)
+        writer.close();
+}
+
+/*==================== functions ====================*/
+
+string path_join(const string& dir, const string& name)
+{
+    if(dir.empty() || dir[dir.length() - 1] == loon::directory_delimiter)
+        return dir + name;
+    return dir + loon::directory_delimiter + name;
+}
+
+// `<id>.txt`, `<id>.sorted.txt` or their binary counterparts. `appended` gives `<id>.append.sorted.*`,
+// which holds the alignments of the new BAM file until they are merged by append_alignments()
+string output_fname(int32_t ref_id, bool appended = false)
+{
+    return path_join(basedir, loon::int2path( ref_id )) + to_string( ref_id ) + (appended ? ".append" : "")
+            + (sort_output ? ".sorted" : "") + (binary_output ? ".bin" : ".txt");
+}
+
+// Assign the IDs to the references of a chunk of a PAF file, and add the new ones to `header`
+void resolve_paf_refs(ExtractChunk& chunk, riginv::BamHeader& header)
+{
+    for(vector<RefAlns>::iterator it = chunk.refs.begin(); it != chunk.refs.end(); ++it)
+    {
+        unordered_map<string, int32_t>::iterator found = paf_ref_ids.find( it->ref_name );
+        if(found == paf_ref_ids.end())
+        {
+            found = paf_ref_ids.insert( make_pair(it->ref_name, static_cast<int32_t>(header.ref_names.size())) ).first;
+            header.ref_names.push_back( it->ref_name );
+            header.ref_lengths.push_back( it->ref_len );
+            ref_outputs.resize( header.ref_names.size() );
+        }
+        else if(header.ref_lengths[ found->second ] != it->ref_len)
+            throw loon::Exception(5, "Reference [%s] has different lengths in [%s]", it->ref_name.c_str(), bam_file);
+        it->ref_id = found->second;
+    }
+}
+
+// With `append_mode`, the references of a PAF file keep their IDs in the working directory
+void load_paf_refs(riginv::BamHeader& header)
+{
+    ifstream fin;
+    loon::open_file(fin, path_join(basedir, "spec.txt"));
+    int32_t ref_id;
+    string name, path;
+    ULL len;
+    while(fin >> ref_id >> name >> len >> path)
+    {
+        if(header.ref_names.size() <= static_cast<size_t>(ref_id))
+        {
+            header.ref_names.resize(ref_id + 1);
+            header.ref_lengths.resize(ref_id + 1, 0);
+        }
+        header.ref_names[ref_id] = name;
+        header.ref_lengths[ref_id] = len;
+        paf_ref_ids[name] = ref_id;
+    }
+    fin.close();
+}
+
+void save_chunk(ExtractChunk& chunk, riginv::BamHeader& header)
+{
+    if(paf_input)
+        resolve_paf_refs(chunk, header);
+    for(vector<RefAlns>::iterator it = chunk.refs.begin(); it != chunk.refs.end(); ++it)
+    {
+        RefOutput& output = ref_outputs[ it->ref_id ];
+        if(output.fname.empty())
+        {
+            string directory = path_join(basedir, loon::int2path( it->ref_id ));
+            loon::mkdir_p( directory );
+            output.fname = output_fname(it->ref_id, append_mode);
+            ref_order.push_back( it->ref_id );
+            if(!sort_output)
+                output.file = out_files->add_file( output.fname );
+            if(binary_output && !sort_output)
+            {
+                // emit a block whenever about `cache_size` bytes of records are held
+                size_t capacity = min<size_t>(cache_size / riginv::BriefAlnBlock::encoded_size(1),
+                        riginv::BRIEF_ALN_BLOCK_CAPACITY);
+                output.encoder.reset( new riginv::BriefAlnEncoder(capacity, true, compress_output) );
+            }
+        }
+        output.write( *it );
+    }
+    // spill the largest runs
+    while(sort_output && run_bytes > sort_memory)
+    {
+        RefOutput* largest = NULL;
+        for(vector<int32_t>::const_iterator it = ref_order.begin(); it != ref_order.end(); ++it)
+            if(largest == NULL || ref_outputs[*it].held_bytes() > largest->held_bytes())
+                largest = &ref_outputs[*it];
+        largest->spill();
+    }
+}
+
+void write_spec(const riginv::BamHeader& header)
+{
+    ofstream fout;
+    loon::open_file(fout, path_join(basedir, "spec.txt"));
+    for(vector<int32_t>::const_iterator it = ref_order.begin(); it != ref_order.end(); ++it)
+        fout << (*it) << ' ' << header.ref_names[ *it ] << ' ' << header.ref_lengths[ *it ] << ' '
+             << path_join(basedir, loon::int2path( *it )) << endl;
+    fout.close();
+
+    if(!write_mk_file)  return;
+    loon::open_file(fout, path_join(basedir, "inc.mk"));
+    fout << "ALN_ROOTDIR=\"" << basedir << '"' << endl;
+    fout << "ALN_SOURCES=";
+    for(vector<int32_t>::const_iterator it = ref_order.begin(); it != ref_order.end(); ++it)
+        fout << loon::int2path( *it ) << (*it) << ' ';
+    fout << endl << "ALN_RUN=" << (ref_order.empty() ? 0 : 1) << endl;
+    fout.close();
+}
+
+// Two-way merge of the existing `fname` and the alignments of the new BAM file in `append_fname`.
+// Equal alignments keep the existing ones first, as if the new BAM file were concatenated to the old one.
+void merge_appended(const string& fname, const string& append_fname)
+{
+    string merged_fname = fname + ".merging";
+    {
+        riginv::BriefAlnReader old_reader(fname);
+        riginv::BriefAlnReader new_reader(append_fname);
+        if(old_reader.is_binary() != binary_output || (binary_output && !old_reader.has_global_ids()))
+            throw loon::Exception(5, "[%s] was not extracted by bam_extract%s", fname.c_str(), binary_output ? " --binary" : "");
+        riginv::BriefAlnWriter writer(merged_fname, binary_output, binary_output, compress_output);
+        riginv::BriefAln old_aln, new_aln;
+        bool has_old = old_reader.next( old_aln );
+        bool has_new = new_reader.next( new_aln );
+        while(has_old || has_new)
+        {
+            bool take_old = has_old && (!has_new || !(new_aln < old_aln));
+            riginv::BriefAlnReader& reader = take_old ? old_reader : new_reader;
+            riginv::BriefAln& aln = take_old ? old_aln : new_aln;
+            if(binary_output)
+                writer.write( aln );
+            else
+                writer.write(aln, reader.read_name( aln.read_id ));
+            if(take_old)
+                has_old = old_reader.next( old_aln );
+            else
+                has_new = new_reader.next( new_aln );
+        }
+        writer.close();
+    }
+    remove( append_fname.c_str() );
+    if(rename(merged_fname.c_str(), fname.c_str()) != 0)
+        throw loon::Exception(2, "Cannot rename [%s] to [%s]", merged_fname.c_str(), fname.c_str());
+}
+
+// Merge the alignments of the new BAM file (`<id>.append.sorted.*` of the references in `ref_order`)
+// into the working directory, and add the references that changed to 'dirty.txt', which lists
+// the references whose later steps have to be rerun.
+void append_alignments(const riginv::BamHeader& header, loon::ThreadPool& pool)
+{
+    size_t n_refs = header.ref_names.size();
+    vector<int32_t> appended;
+    appended.swap( ref_order );
+    vector<bool> existing(n_refs, false);
+    {
+        ifstream fin;
+        loon::open_file(fin, path_join(basedir, "spec.txt"));
+        int32_t ref_id;
+        string name, path;
+        ULL len;
+        while(fin >> ref_id >> name >> len >> path)
+        {
+            if(ref_id < 0 || static_cast<size_t>(ref_id) >= n_refs || header.ref_names[ref_id] != name || header.ref_lengths[ref_id] != len)
+                throw loon::Exception(5, "The references of [%s] do not match the working directory", bam_file);
+            existing[ref_id] = true;
+            ref_order.push_back( ref_id );
+        }
+        fin.close();
+    }
+
+    set<int32_t> dirty;
+    string dirty_fname = path_join(basedir, "dirty.txt");
+    {
+        ifstream fin( dirty_fname.c_str() );     // may not exist
+        int32_t ref_id;
+        while(fin >> ref_id)
+            dirty.insert( ref_id );
+    }
+    vector<future<void> > done;
+    for(vector<int32_t>::const_iterator it = appended.begin(); it != appended.end(); ++it)
+    {
+        dirty.insert( *it );
+        string fname = output_fname( *it );
+        string append_fname = output_fname(*it, true);
+        if(existing[*it])
+        {
+            done.push_back( pool.submit( [fname, append_fname](){ merge_appended(fname, append_fname); } ) );
+            continue;
+        }
+        if(rename(append_fname.c_str(), fname.c_str()) != 0)
+            throw loon::Exception(2, "Cannot rename [%s] to [%s]", append_fname.c_str(), fname.c_str());
+        ref_order.push_back( *it );
+    }
+    for(size_t i = 0; i < done.size(); ++i)
+        done[i].get();
+
+    write_spec(header);
+    ofstream fout;
+    loon::open_file(fout, dirty_fname);
+    for(vector<int32_t>::const_iterator it = ref_order.begin(); it != ref_order.end(); ++it)
+        if(dirty.count( *it ) != 0)
+            fout << (*it) << endl;
+    fout.close();
+}
+
+// Save the spec files, or merge the alignments into the working directory with `append_mode`
+void finish_extraction(const riginv::BamHeader& header, loon::ThreadPool& pool)
+{
+    if(binary_output)
+        read_dict.save( path_join(basedir, "reads.dict") );
+    if(append_mode)
+    {
+        append_alignments(header, pool);
+        return;
+    }
+    write_spec(header);
+    // all the references are new to the later steps
+    remove( path_join(basedir, "dirty.txt").c_str() );
+}
+
+void extract_bam()
+{
+    loon::ThreadPool pool( n_threads );
+    // the references of a PAF file are added to `header` as they appear
+    unique_ptr<riginv::BamReader> bam_reader;
+    unique_ptr<riginv::PafReader> paf_reader;
+    riginv::BamHeader header;
+    if(paf_input)
+    {
+        paf_reader.reset( new riginv::PafReader(bam_file) );
+        if(append_mode)
+            load_paf_refs(header);
+    }
+    else
+    {
+        bam_reader.reset( new riginv::BamReader(bam_file, &pool) );
+        header = bam_reader->header();
+    }
+    ref_outputs.resize( header.ref_names.size() );
+    out_files.reset( new loon::ManyFileWriter(max_nfiles, cache_size, memory_budget) );
+
+    // chunks are extracted by the thread pool and saved in order by this thread
+    const size_t max_inflight = (n_threads << 1) + 2;
+    size_t n_refs = header.ref_names.size();
+    deque<shared_ptr<ExtractChunk> > inflight;
+    shared_ptr<ExtractChunk> chunk = make_shared<ExtractChunk>();
+    while(paf_input ? paf_reader->next_chunk( chunk->raw ) : bam_reader->next_chunk( chunk->raw ))
+    {
+        ExtractChunk* job = chunk.get();
+        chunk->done = pool.submit( [job, n_refs](){ job->extract(n_refs); } );
+        inflight.push_back( chunk );
+        chunk = make_shared<ExtractChunk>();
+        while(inflight.size() >= max_inflight || (!inflight.empty() && inflight.front()->done.wait_for(chrono::seconds(0)) == future_status::ready))
+        {
+            inflight.front()->done.get();
+            save_chunk(*inflight.front(), header);
+            inflight.pop_front();
+        }
+    }
+    while(!inflight.empty())
+    {
+        inflight.front()->done.get();
+        save_chunk(*inflight.front(), header);
+        inflight.pop_front();
+    }
+    if(sort_output)
+    {// sort or merge the runs of the references in parallel
+        vector<future<void> > done;
+        for(vector<int32_t>::const_iterator it = ref_order.begin(); it != ref_order.end(); ++it)
+        {
+            RefOutput* output = &ref_outputs[ *it ];
+            done.push_back( pool.submit( [output](){ output->finish_sorted(); } ) );
+        }
+        for(size_t i = 0; i < done.size(); ++i)
+            done[i].get();
+    }
+    else
+        for(vector<int32_t>::const_iterator it = ref_order.begin(); it != ref_order.end(); ++it)
+            ref_outputs[ *it ].finish();
+    finish_extraction(header, pool);
+}
+
+// Write the alignments with the same `ref_start` in the order of BriefAln::operator<
+void write_group(vector<riginv::BriefAln>& group, const Region& part, const riginv::BriefAlnReader& reader, riginv::BriefAlnWriter& writer)
+{
+    stable_sort(group.begin(), group.end());
+    for(vector<riginv::BriefAln>::iterator it = group.begin(); it != group.end(); ++it)
+    {
+        if(binary_output)
+        {
+            it->read_id = part.id_map[ it->read_id ];
+            writer.write( *it );
+        }
+        else
+            writer.write(*it, reader.read_name( it->read_id ));
+    }
+    group.clear();
+}
+
+// Merge the part files of a reference into `<id>.sorted.txt` or `<id>.sorted.bin`.
+// The BAM file is sorted by `ref_start` (it has an index), so only the alignments with the
+// same `ref_start`, which are in the same part, need to be sorted.
+void merge_sorted_parts(const vector<Region*>& parts, const string& fname)
+{
+    riginv::BriefAlnWriter writer(fname, binary_output, binary_output, compress_output);
+    vector<riginv::BriefAln> group;
+    riginv::BriefAln aln;
+    for(vector<Region*>::const_iterator it = parts.begin(); it != parts.end(); ++it)
+    {
+        {
+            riginv::BriefAlnReader reader( (*it)->fname );
+            while(reader.next( aln ))
+            {
+                if(!group.empty() && aln.ref_start != group[0].ref_start)
+                {
+                    if(aln.ref_start < group[0].ref_start)
+                        throw loon::Exception(5, "[%s] is not sorted by coordinates", bam_file);
+                    write_group(group, **it, reader, writer);
+                }
+                group.push_back( aln );
+            }
+            write_group(group, **it, reader, writer);
+        }
+        remove( (*it)->fname.c_str() );
+    }
+    writer.close();
+}
+
+// Concatenate the part files of a reference into `<id>.txt` or `<id>.bin`
+void merge_parts(const vector<Region*>& parts, const string& fname)
+{
+    if(sort_output)
+    {
+        merge_sorted_parts(parts, fname);
+        return;
+    }
+    if(!binary_output && parts.size() == 1)
+    {
+        if(rename(parts[0]->fname.c_str(), fname.c_str()) != 0)
+            throw loon::Exception(2, "Cannot rename [%s] to [%s]", parts[0]->fname.c_str(), fname.c_str());
+        return;
+    }
+    if(!binary_output)
+    {
+        ofstream fout;
+        loon::open_file(fout, fname, true);
+        for(vector<Region*>::const_iterator it = parts.begin(); it != parts.end(); ++it)
+        {
+            ifstream fin;
+            loon::open_file(fin, (*it)->fname, true);
+            fout << fin.rdbuf();
+            fin.close();
+            remove( (*it)->fname.c_str() );
+        }
+        fout.close();
+        return;
+    }
+    riginv::BriefAlnWriter writer(fname, true, true, compress_output);
+    riginv::BriefAln aln;
+    for(vector<Region*>::const_iterator it = parts.begin(); it != parts.end(); ++it)
+    {
+        {
+            riginv::BriefAlnReader reader( (*it)->fname );
+            while(reader.next( aln ))
+            {
+                aln.read_id = (*it)->id_map[ aln.read_id ];
+                writer.write( aln );
+            }
+        }
+        remove( (*it)->fname.c_str() );
+    }
+    writer.close();
+}
+
+void extract_regions()
+{
+    string index_fname = riginv::BamIndex::locate( bam_file );
+    if(index_fname.empty())
+        throw loon::Exception(1, "Cannot find the index (.bai or .csi) of [%s]", bam_file);
+    bam_index.load( index_fname );
+    riginv::BamHeader header;
+    {
+        riginv::BamReader reader(bam_file);
+        header = reader.header();
+    }
+    size_t n_refs = header.ref_names.size();
+    if(bam_index.refs.size() != n_refs)
+        throw loon::Exception(5, "The index [%s] does not match [%s]", index_fname.c_str(), bam_file);
+
+    // slices of each reference in order
+    deque<Region> regions;
+    vector<vector<Region*> > ref_regions(n_refs);
+    for(size_t r = 0; r < n_refs; ++r)
+    {
+        if(!bam_index.refs[r].has_alignments)
+            continue;
+        string directory = path_join(basedir, loon::int2path( r ));
+        loon::mkdir_p( directory );
+        ULL len = max<ULL>(header.ref_lengths[r], 1);
+        ULL step = slice_length == 0 ? len : slice_length;
+        for(ULL start = 0; start < len; start += step)
+        {
+            regions.push_back( Region() );
+            Region& region = regions.back();
+            region.ref_id = r;
+            region.start = start;
+            region.end = start + step >= len ? ULLONG_MAX : start + step;
+            region.fname = directory + to_string(r) + ".part" + to_string(ref_regions[r].size()) + (binary_output ? ".bin" : ".txt");
+            ref_regions[r].push_back( &region );
+        }
+    }
+
+    loon::ThreadPool pool( n_threads );
+    vector<future<void> > done;
+    for(deque<Region>::iterator it = regions.begin(); it != regions.end(); ++it)
+    {
+        Region* region = &(*it);
+        done.push_back( pool.submit( [region, n_refs](){ region->extract(n_refs); } ) );
+    }
+    for(size_t i = 0; i < done.size(); ++i)
+        done[i].get();
+
+    // Read IDs are assigned in the order of the alignments in the BAM file, as in extract_bam()
+    vector<vector<Region*> > ref_parts(n_refs);
+    for(size_t r = 0; r < n_refs; ++r)
+    {
+        for(vector<Region*>::iterator it = ref_regions[r].begin(); it != ref_regions[r].end(); ++it)
+        {
+            if((*it)->n_alns == 0)  continue;
+            ref_parts[r].push_back( *it );
+            if(!binary_output)  continue;
+            riginv::BriefAlnReader reader( (*it)->fname );
+            (*it)->id_map.resize( reader.n_reads() );
+            for(size_t i = 0; i < reader.n_reads(); ++i)
+                (*it)->id_map[i] = read_dict.add( reader.read_name(i) );
+        }
+        if(!ref_parts[r].empty())
+            ref_order.push_back( r );
+    }
+    done.clear();
+    for(vector<int32_t>::const_iterator it = ref_order.begin(); it != ref_order.end(); ++it)
+    {
+        const vector<Region*>* parts = &ref_parts[ *it ];
+        string fname = output_fname(*it, append_mode);
+        done.push_back( pool.submit( [parts, fname](){ merge_parts(*parts, fname); } ) );
+    }
+    for(size_t i = 0; i < done.size(); ++i)
+        done[i].get();
+    finish_extraction(header, pool);
+}
+
+void parse_args(int argc, char* argv[])
+{
+    loon::SimpleHelp help("bam_extract [options] <required parameters>");
+    help.add_argument("Input BAM file (or PAF file with --paf)");
+    help.add_argument("Working directory. The brief alignments are saved in <working directory>/intermediate_results/");
+    help.add_option("-t", "Number of threads", "1");
+    help.add_option("--cache-size", "Hold <= this number of bytes for each file before flushing to the disk", "1048576");
+    help.add_option("--max-nfiles", "Maximum number of files open at the same time", "512");
+    help.add_option("--memory-budget", "Hold <= this number of bytes for all the files", "268435456");
+    help.add_flag("-m", "Generate the 'inc.mk' file for makefiles");
+    help.add_flag("--paf", "The input is a PAF file (e.g., the output of minimap2), which may be gzip compressed");
+    help.add_flag("--use-index", "Extract the references (or slices of them) located by the BAM index (.bai or .csi) in parallel");
+    help.add_option("--slice-length", "With --use-index, extract the references longer than this in slices of this length", "20000000");
+    help.add_flag("--binary", "Save <id>.bin in the binary brief alignment format instead of <id>.txt, and the read dictionary 'reads.dict'");
+    help.add_flag("--compress", "With --binary, varint encode the blocks of the brief alignments");
+    help.add_flag("--sort", "Save the sorted brief alignments <id>.sorted.txt (or <id>.sorted.bin) instead of <id>.txt");
+    help.add_option("--sort-memory", "With --sort, spill the alignments to the disk when they take more than this number of bytes", "1073741824");
+    help.add_flag("--append", "Merge the sorted brief alignments into those already in the working directory (extracted from a BAM file with the same references and the same options), and list the references that changed in 'dirty.txt'. Implies --sort");
+
+    help.check(argc, argv);
+
+    bam_file = argv[1];
+    basedir = path_join(argv[2], "intermediate_results");
+    n_threads = stoull( help.get_option("-t") );
+    cache_size = stoull( help.get_option("--cache-size") );
+    max_nfiles = stoull( help.get_option("--max-nfiles") );
+    memory_budget = stoull( help.get_option("--memory-budget") );
+    write_mk_file = help.is_set("-m");
+    binary_output = help.is_set("--binary");
+    compress_output = binary_output && help.is_set("--compress");
+    paf_input = help.is_set("--paf");
+    use_index = help.is_set("--use-index") && !paf_input;     // a PAF file has no index
+    slice_length = stoull( help.get_option("--slice-length") );
+    sort_output = help.is_set("--sort");
+    sort_memory = stoull( help.get_option("--sort-memory") );
+    append_mode = help.is_set("--append");
+    sort_output = sort_output || append_mode;
+    if(n_threads == 0)  n_threads = 1;
+}
+
+int main(int argc, char* argv[])
+{
+    parse_args(argc, argv);
+    loon::mkdir_p( basedir );
+    if(append_mode && binary_output)    // new reads get the IDs after those of the working directory
+        read_dict.load( path_join(basedir, "reads.dict") );
+    if(use_index)
+        extract_regions();
+    else
+        extract_bam();
+    return 0;
+}
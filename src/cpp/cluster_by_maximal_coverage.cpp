@@ -10,6 +10,9 @@
 #include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
 #include <loonutil/logger.h>
+#include <loonutil/numFormat.h>
+#include <loonutil/mappedTextReader.h>
+#include <loonutil/manyFileWriter.h>
 #include <alglib/cpp/src/specialfunctions.h>
 
 using namespace std;
@@ -48,6 +51,7 @@ vector<LocalMaximal> local_maximal;
 vector<long double> P;
 size_t cluster_id = 0;
 ofstream fout_predictions, fout_spec;
+loon::ManyFileWriter cluster_files(512, 65536, 67108864);   // the clusters are small, so they are buffered together
 
 /*=========================== class Rect_T ===========================*/
 class Rect: public RectBase
@@ -240,6 +244,18 @@ inline void print_rect(ostream& fout, const Rect& t, bool print_brace = false)
     else    fout << endl;
 }
 
+// the same line as print_rect(fout, t, true)
+inline void append_rect(string& out, const Rect& t)
+{
+    for(size_t i = 0; i < 4; ++i)
+    {
+        loon::append_int(out, t[i]);
+        out.push_back(' ');
+    }
+    out.push_back(t.brace);
+    out.push_back('\n');
+}
+
 // save the cluster in `t`
 void print_cluster(const LocalMaximal& t)
 {
@@ -252,13 +268,13 @@ void print_cluster(const LocalMaximal& t)
     prefix += to_string( cluster_id ); // the prefix name of the cluster file
 
     // save the cluster to its file
-    ofstream fout;
-    loon::open_file(fout, prefix + ".txt");
+    size_t file = cluster_files.add_file(prefix + ".txt");
+    string lines;
     for(vector<size_t>::const_iterator it = t.rect_indices.begin(); it != t.rect_indices.end(); ++it)
     {
-        print_rect(fout, rects[ *it ], true);
+        append_rect(lines, rects[ *it ]);
     }
-    fout.close();
+    cluster_files.write(file, lines);
 
     ++cluster_id;
 }
@@ -524,16 +540,17 @@ bool compare_rect(const Rect& lhs, const Rect& rhs)
 }
 void read_rects()
 {
-    ifstream fin;
-    loon::open_file(fin, infile);
+    loon::MappedTextReader fin(infile);
     Rect tmp;
-    while(fin >> tmp[0])
+    while(fin.read_signed(tmp[0]))
     {
-        fin >> tmp[1] >> tmp[2] >> tmp[3] >> tmp.brace >> tmp.dist;
+        fin.read_signed(tmp[1]);
+        fin.read_signed(tmp[2]);
+        fin.read_signed(tmp[3]);
+        fin.read_char(tmp.brace);
+        fin.read_signed(tmp.dist);
         rects.push_back( tmp );
-
     }
-    fin.close();
     sort(rects.begin(), rects.end(), compare_rect);// sort in ascending order, w.r.t. the longest sides of the rect
     rects.resize( static_cast<size_t>(rects.size() * (1 - remove_portion)) );// keep only a proportion of the rectangles
     M = rects.size();
@@ -601,6 +618,7 @@ int main(int argc, char* argv[])
 
     init();
     run_clustering();
+    cluster_files.close_all();
     fout_predictions.close();
     fout_spec.close();
     return 0;
@@ -3,11 +3,21 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <atomic>
+#include <future>
 #include <cstdlib>
+#include <sys/stat.h>
 
 #include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
-#include <loonalgorithm/LCA/RMQnlogn.hpp>
+#include <loonutil/threadPool.h>
+#include <riginvutil/briefAlignment.h>
+#include <riginvutil/coverageTrack.h>
+#include <riginvutil/coveragePyramid.h>
+#include <riginvutil/readSegmentMap.h>
 
 using namespace std;
 
@@ -17,20 +27,18 @@ class OneAln;
 class SegEndpoint;
 
 /*====================== command line parameters ================*/
-ULL ref_len = 0;
 ULL min_cutoff = 0;// A ref base is covered by an alignment if it's left `min_cutoff` number of bases and right `min_cutoff` number bases are covered in the alignment
 ULL min_overlap = 0;// Two alignment are consecutive if they overlap at least `min_overlap` bases
 ULL min_aln_len = 0;// Discard alignments whose length is < min_aln_len (min_aln_len > 2 * min_cutoff + 1)
 ULL min_mapping_quality = 0;// Discard alignments whose mapping quality is < min_mapping_quality
-char* infile;// Input file name
-char* outfile;// Output file name
-int min_cvg = 0;// if the max coverage of an alignment is < min_cvg, remove it
+unsigned int min_cvg = 0;// if the max coverage of an alignment is < min_cvg, remove it
 double min_cvg_percent = 0;// if the max coverage ratio of an alignment is < min_cvg_percent, remove it
+bool streaming = false;// sweep the sorted alignments in one pass, holding only those overlapping the current position
+bool rerun = false;// decide the alignments from the coverage pyramid and the coverage track of an earlier run, instead of the sweep
+size_t n_threads = 1;// with --batch, the contigs are analyzed by this number of threads
 
 /*====================== global variables =======================*/
-vector<OneAln> alignments;
-vector<SegEndpoint> segEndpoints;
-double total_covered_length = 0;
+const vector<ULL> pyramid_bin_widths = {1000, 10000, 100000};
 
 /*====================== class SegEndpoint ======================*/
 class SegEndpoint
@@ -61,15 +69,25 @@ class OneAln
 {
 public:
     ULL ref_start, ref_end;
-    string qname;
+    unsigned int read_id;       // as assigned by riginv::BriefAlnReader
     ULL mapping_quality;
 public:
+    OneAln();
+    OneAln(const riginv::BriefAln& aln);
     void invalidate();
     bool is_valid() const;
     bool satisfies(ULL m_aln_len, ULL m_map_quality) const;
-    friend istream& operator>>(istream& in, OneAln& obj);
 };
 
+OneAln::OneAln():
+        ref_start(0), ref_end(0), read_id(0), mapping_quality(0)
+{}
+
+OneAln::OneAln(const riginv::BriefAln& aln):
+        ref_start(aln.ref_start), ref_end(aln.ref_end),
+        read_id(aln.read_id), mapping_quality(aln.mapq)
+{}
+
 void OneAln::invalidate()
 {
     ref_end = 0;
@@ -89,153 +107,499 @@ bool OneAln::satisfies(ULL m_aln_len, ULL m_map_quality) const
     return true;
 }
 
-istream& operator>>(istream& in, OneAln& obj)
+
+/*======================= class SegmentMerger ===================*/
+
+// Merge the valid alignments, in the order of `ref_start`, into the validated segments
+class SegmentMerger
 {
-    std::string tmp;
-    if(in >> obj.ref_start)
-    {
-        in >> obj.ref_end;
-        in >> tmp >> tmp; // filter out `qry_start` and `qry_end`
-        in >> obj.qname;
-        in >> tmp >> tmp; // filter out `ref_len` and `qry_len`
-        in >> obj.mapping_quality;
-        getline(in, tmp); // filter out orientation
+private:
+    ofstream fout;
+    ULL start_loc, end_loc;
+    unsigned int n_segments;    // number of the segments written
+    vector<pair<unsigned int, unsigned int> >* read_segments;
+public:
+    SegmentMerger(const string& fname, vector<pair<unsigned int, unsigned int> >* read_segments = NULL);
+    void add(const OneAln& aln);
+    void close();
+};
+
+SegmentMerger::SegmentMerger(const string& fname, vector<pair<unsigned int, unsigned int> >* read_segments):
+        start_loc(0), end_loc(0), n_segments(0), read_segments(read_segments)
+{
+    loon::open_file(fout, fname);
+}
+
+void SegmentMerger::add(const OneAln& aln)
+{
+    if(end_loc == 0)
+    { // the first segment
+        start_loc = aln.ref_start;
+        end_loc = aln.ref_end;
     }
-    return in;
+    else if(end_loc <= (aln.ref_start + min_overlap))
+    { // new segment
+        fout << start_loc << ' ' << end_loc << endl;
+        ++n_segments;
+        start_loc = aln.ref_start;
+        end_loc = aln.ref_end;
+    }
+    else if(end_loc < (aln.ref_end))
+    { // update right-end
+        end_loc = aln.ref_end;
+    }
+    // qname <--> count(start_loc, end_loc) maps the alignment to its validated segment
+    if(read_segments != NULL)
+        read_segments->push_back( make_pair(aln.read_id, n_segments) );
 }
 
+void SegmentMerger::close()
+{
+    if(end_loc > 0)
+        fout << start_loc << ' ' << end_loc << endl;
+    fout.close();
+}
 
-/*=========================== functions =========================*/
+/*======================= class WindowAln =======================*/
 
-void read_alignments()
+// An alignment from its start to the merge of its segment, in the streaming mode
+class WindowAln
 {
-    ifstream fin;
-    loon::open_file(fin, infile);
-    OneAln tmp_aln;
-    while( fin >> tmp_aln)
+public:
+    OneAln aln;
+    size_t q_segStart;  // index of the coverage after its start
+    bool is_swept;      // its end is swept, so it is valid or invalidated
+public:
+    WindowAln(const OneAln& aln, size_t q_start):
+            aln(aln), q_segStart(q_start), is_swept(false)
+    {}
+};
+
+/*======================= class ContigSpec ======================*/
+
+// The files of a contig
+class ContigSpec
+{
+public:
+    ULL ref_len;
+    string infile, outfile;
+    string coverage_fname;  // if not empty, write the coverage of the alignments in consideration as a coverage track (read with `rerun`)
+    string pyramid_fname;   // if not empty, write the coverage pyramid of the coverage (read with `rerun`)
+    string read_map_fname;  // if not empty, write the validated segments of each read as a read segment map
+public:
+    ContigSpec(): ref_len(0) {}
+};
+
+/*======================= class ContigAnalysis ==================*/
+
+/*! \brief The analysis of contigs
+ *
+ * An object can run the contigs one after another, and keeps the memory of its vectors
+ * for the next one.
+ */
+class ContigAnalysis
+{
+private:
+    ContigSpec contig;
+    vector<OneAln> alignments;
+    vector<SegEndpoint> segEndpoints;
+    vector<size_t> q_segStart;
+    vector<pair<size_t, size_t> > suffix_max;
+    double total_covered_length;
+    unsigned int contig_min_cvg;    // `min_cvg`, or more by `min_cvg_percent`
+    riginv::CoverageTrackWriter coverage_track;
+    riginv::CoveragePyramid pyramid;
+    vector<pair<unsigned int, unsigned int> > read_segments;// (read ID, segment index) of the valid alignments, for the read segment map
+
+    bool read_next(riginv::BriefAlnReader& reader, OneAln& tmp_aln);
+    void read_alignments(riginv::BriefAlnReader& reader);
+    void update_min_cvg();
+    void add_coverage(ULL start, size_t cvg);
+    template<class Container>
+    void index_coverage(Container& suffix_max, size_t& n_indexed, size_t cur_cvg, ULL& last_pos, ULL loc);
+    void remove_low_coverage_reads();
+    void generate_validated_segments();
+    void stream_validated_segments();
+    bool is_low_coverage(riginv::CoverageTrackReader& track, ULL first, ULL last) const;
+    void rerun_validated_segments();
+    void write_read_map(const riginv::BriefAlnReader& reader);
+public:
+    ContigAnalysis();
+    void run(const ContigSpec& contig);
+};
+
+ContigAnalysis::ContigAnalysis():
+        total_covered_length(0), contig_min_cvg(0)
+{}
+
+// The next alignment in consideration
+bool ContigAnalysis::read_next(riginv::BriefAlnReader& reader, OneAln& tmp_aln)
+{
+    riginv::BriefAln aln;
+    while(reader.next( aln ))
     {
+        tmp_aln = OneAln( aln );
         if(tmp_aln.satisfies(min_aln_len, min_mapping_quality))
         {
-            segEndpoints.emplace_back(tmp_aln.ref_start + min_cutoff,
-                    alignments.size(),
-                    true);
-            segEndpoints.emplace_back(tmp_aln.ref_end - min_cutoff,
-                    alignments.size(),
-                    false);
-            alignments.push_back( tmp_aln );
             total_covered_length = tmp_aln.ref_end - tmp_aln.ref_start - (min_cutoff << 1);
+            return true;
         }
     }
-    fin.close();
+    return false;
+}
+
+void ContigAnalysis::read_alignments(riginv::BriefAlnReader& reader)
+{
+    OneAln tmp_aln;
+    while(read_next(reader, tmp_aln))
+    {
+        segEndpoints.emplace_back(tmp_aln.ref_start + min_cutoff,
+                alignments.size(),
+                true);
+        segEndpoints.emplace_back(tmp_aln.ref_end - min_cutoff,
+                alignments.size(),
+                false);
+        alignments.push_back( tmp_aln );
+    }
+}
+
+void ContigAnalysis::update_min_cvg()
+{
+    contig_min_cvg = max<unsigned int>( min_cvg, total_covered_length * min_cvg_percent / contig.ref_len );
+}
+
+// The coverage from `start` on, to the coverage track and the coverage pyramid
+void ContigAnalysis::add_coverage(ULL start, size_t cvg)
+{
+    if(coverage_track.opened())
+        coverage_track.add(start, cvg);
+    if(!contig.pyramid_fname.empty())
+        pyramid.add(start, cvg);
 }
 
-void remove_low_coverage_reads()
+/*! Index the coverage over [`last_pos`, `loc`), before the endpoints at `loc`, and add it to the
+ * coverage track and pyramid. `suffix_max` holds the maximums of the suffixes of the coverage indexed so far,
+ * with decreasing coverage, so the maximum from an index is at the first entry after it.
+ */
+template<class Container>
+void ContigAnalysis::index_coverage(Container& suffix_max, size_t& n_indexed, size_t cur_cvg, ULL& last_pos, ULL loc)
 {
-    min_cvg = max( min_cvg, int(total_covered_length * min_cvg_percent / ref_len) );
+    while(!suffix_max.empty() && suffix_max.back().second <= cur_cvg)
+        suffix_max.pop_back();
+    suffix_max.push_back( make_pair(n_indexed++, cur_cvg) );
+    add_coverage(last_pos, cur_cvg);
+    last_pos = loc;
+}
+
+// The coverage between consecutive endpoints is indexed in the order of the sweep, and the maximum
+// coverage of an alignment is over the indices from its start to its end, which are all known at
+// its end (c.f. index_coverage())
+void ContigAnalysis::remove_low_coverage_reads()
+{
+    update_min_cvg();
     sort(segEndpoints.begin(), segEndpoints.end());
     size_t nn = alignments.size();
 
-    vector<size_t> q_segStart( nn ); // start index of RMQ
-    vector<size_t> q_segEnd( nn );   // end index of RMQ
-    size_t last_pos = 0;
-    loon::RMQnlogn<size_t> rmq;
-    size_t cur_cvg = 0, cur_index = 1;
+    q_segStart.resize( nn ); // index of the coverage after the start of an alignment
+    suffix_max.clear();     // (index, coverage)
+    ULL last_pos = 0;
+    size_t cur_cvg = 0, n_indexed = 0;
     for(size_t i = 0; i < (nn << 1); ++i)
     {
-        if(segEndpoints[i].is_start)
+        const SegEndpoint& endpoint = segEndpoints[i];
+        if(endpoint.loc != last_pos)
+            index_coverage(suffix_max, n_indexed, cur_cvg, last_pos, endpoint.loc);
+        if(endpoint.is_start)
         {
-            if(segEndpoints[i].loc == last_pos)
-                q_segStart[ segEndpoints[i].seg_id ] = cur_index - 1;
-            else
-            {
-                q_segStart[ segEndpoints[i].seg_id ] = cur_index;
-                rmq.push_back( nn - cur_cvg );
-                ++cur_index;
-                last_pos = segEndpoints[i].loc;
-            }
+            q_segStart[ endpoint.seg_id ] = n_indexed;
             ++cur_cvg;
         }
         else
-        {
-            if(last_pos == segEndpoints[i].loc)
-                q_segEnd[ segEndpoints[i].seg_id ] = cur_index - 2;
-            else
-            {
-                q_segEnd[ segEndpoints[i].seg_id ] = cur_index - 1;
-                rmq.push_back( nn - cur_cvg );
-                ++cur_index;
-                last_pos = segEndpoints[i].loc;
-            }
+        { // Range maximum query and remove low coverage reads
+            size_t max_cvg = lower_bound(suffix_max.begin(), suffix_max.end(),
+                    make_pair(q_segStart[ endpoint.seg_id ], size_t(0)))->second;
+            if(max_cvg < contig_min_cvg)    alignments[ endpoint.seg_id ].invalidate();
             --cur_cvg;
         }
     }
-    rmq.push_back( nn - cur_cvg );
-    // Range maximum query and remove low coverage reads
-    rmq.preprocess();
-    for(size_t i = 0; i < nn; ++i)
-    {
-        size_t max_cvg = nn - rmq.query( q_segStart[i], q_segEnd[i] );
-        if(max_cvg < min_cvg)   alignments[i].invalidate();
-    }
+    add_coverage(last_pos, cur_cvg);
     segEndpoints.clear();
 }
 
-void generate_validated_segments()
+void ContigAnalysis::write_read_map(const riginv::BriefAlnReader& reader)
 {
-    ofstream fout;
-    loon::open_file(fout, outfile);
+    riginv::ReadSegmentMap read_map;
+    read_map.build(read_segments, reader);
+    read_map.save( contig.read_map_fname );
+}
 
-    ULL start_loc = 0, end_loc = 0;
+void ContigAnalysis::generate_validated_segments()
+{
+    SegmentMerger merger(contig.outfile, contig.read_map_fname.empty() ? NULL : &read_segments);
     for(vector<OneAln>::const_iterator it = alignments.begin(); it != alignments.end(); ++it)
         if(it->is_valid())
+            merger.add( *it );
+    merger.close();
+}
+
+/*! The same as read_alignments(), remove_low_coverage_reads() and generate_validated_segments()
+ * in one pass over the alignments sorted by `ref_start`. The starts are swept in the order of
+ * the input, and the ends from a heap. The alignments are held in `window` in the order of the
+ * input from their start until their end and the ends of the alignments before them are swept,
+ * and then merged. So only the alignments overlapping the span of the oldest one are held.
+ */
+void ContigAnalysis::stream_validated_segments()
+{
+    if(min_cvg_percent > 0)
+    { // the threshold depends on the last alignment in consideration
+        riginv::BriefAlnReader reader(contig.infile);
+        OneAln tmp_aln;
+        while(read_next(reader, tmp_aln))
+            ;
+    }
+    update_min_cvg();
+
+    riginv::BriefAlnReader reader(contig.infile);
+    SegmentMerger merger(contig.outfile, contig.read_map_fname.empty() ? NULL : &read_segments);
+    deque<WindowAln> window;
+    size_t window_first = 0;    // number of the alignments merged before `window`
+    priority_queue<pair<ULL, size_t>, vector<pair<ULL, size_t> >, greater<pair<ULL, size_t> > > ends;    // (loc, number of the alignment)
+    deque<pair<size_t, size_t> > suffix_max;    // (index, coverage), as in remove_low_coverage_reads()
+    ULL last_pos = 0;
+    size_t cur_cvg = 0, n_indexed = 0;
+    OneAln next_aln;
+    bool has_next = read_next(reader, next_aln);
+    while(has_next || !ends.empty())
+    {
+        // the ends go before the starts at the same position
+        bool is_start = has_next && (ends.empty() || ends.top().first > next_aln.ref_start + min_cutoff);
+        ULL loc = is_start ? next_aln.ref_start + min_cutoff : ends.top().first;
+        if(loc != last_pos)
+            index_coverage(suffix_max, n_indexed, cur_cvg, last_pos, loc);
+        if(is_start)
         {
-            if(end_loc == 0)
-            { // the first segment
-                start_loc = it->ref_start;
-                end_loc = it->ref_end;
-            }
-            else if(end_loc <= (it->ref_start + min_overlap))
-            { // new segment
-                fout << start_loc << ' ' << end_loc << endl;
-                start_loc = it->ref_start;
-                end_loc = it->ref_end;
-            }
-            else if(end_loc < (it->ref_end))
-            { // update right-end
-                end_loc = it->ref_end;
-            }
-            // qname <--> count(start_loc, end_loc). This can be used to map the alignment to the validated segments
+            ends.push( make_pair(next_aln.ref_end - min_cutoff, window_first + window.size()) );
+            window.emplace_back(next_aln, n_indexed);
+            ++cur_cvg;
+            ULL ref_start = next_aln.ref_start;
+            has_next = read_next(reader, next_aln);
+            if(has_next && next_aln.ref_start < ref_start)
+                throw loon::Exception(8, "[%s] is not sorted by ref_start", contig.infile.c_str());
+            continue;
         }
-    if(end_loc > 0)
-        fout << start_loc << ' ' << end_loc << endl;
-    fout.close();
+
+        WindowAln& swept = window[ ends.top().second - window_first ];
+        ends.pop();
+        size_t max_cvg = lower_bound(suffix_max.begin(), suffix_max.end(),
+                make_pair(swept.q_segStart, size_t(0)))->second;
+        if(max_cvg < contig_min_cvg)    swept.aln.invalidate();
+        swept.is_swept = true;
+        --cur_cvg;
+        for(; !window.empty() && window.front().is_swept; ++window_first)
+        {
+            if(window.front().aln.is_valid())
+                merger.add( window.front().aln );
+            window.pop_front();
+        }
+        // the coverage before the start of the oldest alignment is not queried any more
+        size_t first_query = window.empty() ? n_indexed : window.front().q_segStart;
+        while(!suffix_max.empty() && suffix_max.front().first < first_query)
+            suffix_max.pop_front();
+    }
+    add_coverage(last_pos, cur_cvg);
+    merger.close();
+    if(!contig.read_map_fname.empty())
+        write_read_map(reader);
+}
+
+// Whether the maximum coverage over [first, last) is below the threshold, from the pyramid, and
+// from the track only where the bins of the pyramid are not enough to tell
+bool ContigAnalysis::is_low_coverage(riginv::CoverageTrackReader& track, ULL first, ULL last) const
+{
+    unsigned int lower, upper;
+    ULL inner_first, inner_last;
+    pyramid.max_bounds(first, last, lower, upper, inner_first, inner_last);
+    if(lower >= contig_min_cvg)     return false;
+    if(upper < contig_min_cvg)      return true;
+    unsigned int max_cvg = max( lower, max(track.max_depth(first, inner_first), track.max_depth(inner_last, last)) );
+    return max_cvg < contig_min_cvg;
 }
 
+/*! The same output as generate_validated_segments() for other thresholds, from the coverage
+ * pyramid and the coverage track written by an earlier run of the same alignments (c.f. run()),
+ * in one pass over the alignments without the sweep.
+ */
+void ContigAnalysis::rerun_validated_segments()
+{
+    pyramid.load( contig.pyramid_fname );
+    if(pyramid.reference_length() != contig.ref_len || pyramid.min_cutoff != min_cutoff
+            || pyramid.min_aln_len != min_aln_len || pyramid.min_mapping_quality != min_mapping_quality)
+        throw loon::Exception(5, "Coverage pyramid [%s] is not of the alignments in consideration of [%s]",
+                contig.pyramid_fname.c_str(), contig.infile.c_str());
+    total_covered_length = pyramid.total_covered_length;
+    update_min_cvg();
+
+    riginv::CoverageTrackReader track( contig.coverage_fname );
+    riginv::BriefAlnReader reader( contig.infile );
+    SegmentMerger merger(contig.outfile, contig.read_map_fname.empty() ? NULL : &read_segments);
+    OneAln aln;
+    while(read_next(reader, aln))
+        if(!is_low_coverage(track, aln.ref_start + min_cutoff, aln.ref_end - min_cutoff))
+            merger.add( aln );
+    merger.close();
+    if(!contig.read_map_fname.empty())
+        write_read_map(reader);
+}
+
+void ContigAnalysis::run(const ContigSpec& contig)
+{
+    this->contig = contig;
+    alignments.clear();
+    segEndpoints.clear();
+    read_segments.clear();
+    total_covered_length = 0;
+    if(rerun)
+    {
+        rerun_validated_segments();
+        return;
+    }
+    if(!contig.coverage_fname.empty())
+        coverage_track.open( contig.coverage_fname );
+    if(!contig.pyramid_fname.empty())
+        pyramid.reset(contig.ref_len, pyramid_bin_widths);
+    if(streaming)
+        stream_validated_segments();
+    else
+    {
+        riginv::BriefAlnReader reader(contig.infile);
+        read_alignments(reader);
+        remove_low_coverage_reads();
+        generate_validated_segments();
+        if(!contig.read_map_fname.empty())
+            write_read_map(reader);
+    }
+    if(coverage_track.opened())
+        coverage_track.close();
+    if(!contig.pyramid_fname.empty())
+    {
+        pyramid.finish();
+        pyramid.min_cutoff = min_cutoff;
+        pyramid.min_aln_len = min_aln_len;
+        pyramid.min_mapping_quality = min_mapping_quality;
+        pyramid.total_covered_length = total_covered_length;
+        pyramid.save( contig.pyramid_fname );
+    }
+}
+
+/*=========================== batch =============================*/
+
+/*! Analyze the contigs of `spec_fname` (the `spec.txt` of the working directory) by `n_threads`
+ * threads. The files of contig `<id>` are `<id path>/<id><suffix>`. Each thread takes the largest
+ * contig left, and keeps its ContigAnalysis for the next one.
+ */
+void analyze_contigs(const string& spec_fname, const string& in_suffix, const string& out_suffix,
+        const string& coverage_suffix, const string& pyramid_suffix, const string& read_map_suffix)
+{
+    vector<ContigSpec> contigs;
+    vector<ULL> sizes;
+    ifstream fin;
+    loon::open_file(fin, spec_fname);
+    string id, name, path;
+    ULL len;
+    while(fin >> id >> name >> len >> path)
+    {
+        if(path.back() != '/')
+            path.push_back('/');
+        ContigSpec contig;
+        contig.ref_len = len;
+        contig.infile = path + id + in_suffix;
+        contig.outfile = path + id + out_suffix;
+        if(!coverage_suffix.empty())
+            contig.coverage_fname = path + id + coverage_suffix;
+        if(!pyramid_suffix.empty())
+            contig.pyramid_fname = path + id + pyramid_suffix;
+        if(!read_map_suffix.empty())
+            contig.read_map_fname = path + id + read_map_suffix;
+        struct stat st;
+        if(stat(contig.infile.c_str(), &st) != 0)
+            throw loon::Exception(1, "Cannot open file [%s]", contig.infile.c_str());
+        contigs.push_back( contig );
+        sizes.push_back( st.st_size );
+    }
+    fin.close();
+
+    vector<size_t> order( contigs.size() );
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b){ return sizes[a] > sizes[b]; });
+
+    atomic<size_t> next_contig(0);
+    loon::ThreadPool pool(n_threads);
+    vector<future<void> > done;
+    for(size_t t = 0; t < pool.size(); ++t)
+        done.push_back( pool.submit( [&contigs, &order, &next_contig](){
+                    ContigAnalysis analysis;
+                    for(size_t i; (i = next_contig++) < order.size(); )
+                        analysis.run( contigs[ order[i] ] );
+                } ) );
+    for(size_t t = 0; t < done.size(); ++t)
+        done[t].get();
+}
+
+/*=========================== main ==============================*/
+
+ContigSpec single_contig;   // without --batch
+string spec_fname;          // with --batch
+string coverage_option, pyramid_option, read_map_option;
+
 void parse_args(int argc, char* argv[])
 {
-    loon::SimpleHelp help("concordant_aln_analysis <required parameters>");
+    loon::SimpleHelp help("concordant_aln_analysis [options] <required parameters>");
 
-    help.add_argument("Length of the reference");
+    help.add_argument("Length of the reference (with --batch, the spec file of the contigs)");
     help.add_argument("Minimum cutoff for identifying one coverage for a base");
     help.add_argument("Minimum overlap for identifying consecutive validated segment");
     help.add_argument("Minimum length of an alignment in consideration");
     help.add_argument("Minimum mapping quality in consideration");
-    help.add_argument("Input file name");
-    help.add_argument("Output file name");
+    help.add_argument("Input file name (with --batch, the suffix of the input files)");
+    help.add_argument("Output file name (with --batch, the suffix of the output files)");
     help.add_argument("Minimum coverage for an alignment to be kept");
     help.add_argument("Minimum coverage ratio for an alignment to be kept");
-    
+    help.add_flag("--stream", "Analyze the input (sorted by ref_start) in one pass, holding only the alignments overlapping the current position");
+    help.add_option("--coverage", "Write the coverage of the alignments in consideration to this coverage track file (with --batch, the suffix)", "");
+    help.add_option("--pyramid", "Write the coverage pyramid (the minimum, maximum and mean coverage of the bins of 1kb, 10kb and 100kb) to this file (with --batch, the suffix)", "");
+    help.add_flag("--rerun", "Decide the alignments from the --pyramid and --coverage files of an earlier run with other thresholds, instead of the sweep");
+    help.add_option("--read-map", "Write the validated segments of each read to this read segment map file (with --batch, the suffix)", "");
+    help.add_flag("--batch", "Analyze all the contigs of a spec file (lines of `id name length path`), the files of which are <path>/<id><suffix>");
+    help.add_option("-t", "Number of threads to analyze the contigs with --batch", "1");
+
     help.check(argc, argv);
 
-    ref_len             = stoull( argv[1] );
     min_cutoff          = stoull( argv[2] );
     min_overlap         = stoull( argv[3] );
     min_aln_len         = stoull( argv[4] );
     min_mapping_quality = stoull( argv[5] );
-    infile = argv[6];
-    outfile = argv[7];
-    min_cvg             = stoi( argv[8] );
+    min_cvg             = stoul( argv[8] );
     min_cvg_percent     = stod( argv[9] );
+    streaming = help.is_set("--stream");
+    coverage_option = help.get_option("--coverage");
+    pyramid_option = help.get_option("--pyramid");
+    read_map_option = help.get_option("--read-map");
+    rerun = help.is_set("--rerun");
+    if(rerun && (coverage_option.empty() || pyramid_option.empty()))
+        throw loon::Exception(5, "The coverage track (--coverage) and the coverage pyramid (--pyramid) of an earlier run are required for --rerun");
+    n_threads = max<size_t>(stoull( help.get_option("-t") ), 1);
+    if(help.is_set("--batch"))
+        spec_fname = argv[1];
+    else
+    {
+        single_contig.ref_len = stoull( argv[1] );
+        single_contig.infile = argv[6];
+        single_contig.outfile = argv[7];
+        single_contig.coverage_fname = coverage_option;
+        single_contig.pyramid_fname = pyramid_option;
+        single_contig.read_map_fname = read_map_option;
+    }
 
     min_aln_len = max(min_aln_len, (min_cutoff << 1) + 1);
 }
@@ -243,8 +607,12 @@ void parse_args(int argc, char* argv[])
 int main(int argc, char* argv[])
 {
     parse_args(argc, argv);
-    read_alignments();
-    remove_low_coverage_reads();
-    generate_validated_segments();
+    if(!spec_fname.empty())
+        analyze_contigs(spec_fname, argv[6], argv[7], coverage_option, pyramid_option, read_map_option);
+    else
+    {
+        ContigAnalysis analysis;
+        analysis.run( single_contig );
+    }
     return 0;
 }
@@ -2,16 +2,20 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
+#include <riginvutil/briefAlignment.h>
+#include <riginvutil/colinearChain.h>
 
 using namespace std;
 
 /*=========== typedef and declarations =====*/
 typedef unsigned long long ULL;
 class OneAln;
+class BackwardSweep;
 
 /*========== command line args ============*/
 char* infile;
@@ -24,7 +28,7 @@ ULL allowed_overlap = 5;
 /*========== global variables ============*/
 vector<vector<OneAln> > alns[2]; // 0 for forward, and 1 for backward
 vector<ULL> qry_lens;            // query length
-map<string, size_t> alns_ids;    // TODO: use Trie
+riginv::ReadSlots read_slots;    // read ID -> index of `alns[0]`, `alns[1]` and `qry_lens`
 
 /*========== debug variables =============*/
 
@@ -35,56 +39,152 @@ class OneAln
 public:
     ULL ref_start, ref_end;
     ULL qry_start, qry_end;
+public:
+    bool operator<(const OneAln& aln) const;
 };
 
-/*========== functions ====================*/
+bool OneAln::operator<(const OneAln& aln) const
+{
+    return ref_start < aln.ref_start;
+}
 
-void save_inversion(ULL x1, ULL x2, ULL y1, ULL y2,
-        const vector<OneAln>& backward, size_t b,
-        ofstream& fout, ULL len)
-{
-    ULL min_x = x2 + allowed_overlap, max_x = 0;
-    ULL last_x = x1, last_y = y1;
-    ULL total_cvg = 0;
-    for(; b < backward.size(); ++b)
-    {// TODO: a better analysis for this part should be a Longest Increasing Sequence
-        if(backward[b].ref_start > x2 + allowed_overlap)    break;
-        if(backward[b].ref_end >= allowed_overlap + x2) continue;
-
-        if(len-backward[b].qry_end <= y2 + allowed_overlap && len - backward[b].qry_start + allowed_overlap >= y1)
-        {
-            min_x = min(min_x, backward[b].ref_start);
-            max_x = max(max_x, backward[b].ref_end);
+/*========== class BackwardSweep =========*/
 
-            if(last_x < backward[b].ref_start)
-            {
-                last_x = backward[b].ref_end;
-                total_cvg += backward[b].ref_end - backward[b].ref_start;
-            }
-            else if(last_x < backward[b].ref_end)
-            {
-                total_cvg += backward[b].ref_end - last_x;
-                last_x = backward[b].ref_end;
-            }
+/*! \brief The sweep of the backward alignments of a read for the pairs of a forward alignment
+ *
+ * For the forward alignment (x1, y1), the pair with (x2, y2) sweeps the backward alignments `b` from
+ * `backward_i` with `ref_end < x2 + allowed_overlap`, `len - qry_end <= y2 + allowed_overlap` and
+ * `len - qry_start + allowed_overlap >= y1`, in the order of `ref_start`. The pairs come in
+ * ascending `x2`, so the alignments join in the order of `ref_end`, and the sweep of a pair goes on
+ * from that of the pair before. It restarts only if an alignment already passed joins, or is in or
+ * out by another `y2` (c.f. `max_key_in` and `min_key_out`).
+ *
+ * The alignments swept are chained on the reference and the reverse-strand query, and the coverage
+ * is that of the best chain.
+ */
+class BackwardSweep
+{
+private:
+    const vector<OneAln>* backward;
+    ULL len;
+    vector<size_t> by_end;      // indices of `backward` in the order of `ref_end`
+    vector<ULL> keys;           // `len - qry_end` of the alignments joined, ULLONG_MAX for the others
+    size_t n_joined;            // alignments of `by_end` considered so far
+    size_t first;               // `backward_i`
+    ULL y1;
+    size_t swept;               // the alignments [first, swept) are passed
+    ULL max_key_in, min_key_out;// keys of the alignments passed
+    riginv::ColinearChainer chainer;
 
-            if(last_y < backward[b].qry_start)
-            {
-                last_y = backward[b].qry_end;
-                total_cvg += backward[b].qry_end - backward[b].qry_start;
-            }
-            else if(last_y < backward[b].qry_end)
-            {
-                total_cvg += backward[b].qry_end - last_y;
-                last_y = backward[b].qry_end;
-            }
+    void restart();
+    void update_best();
+public:
+    ULL min_start, max_end, total_cvg;  // of the best chain of the alignments swept
+public:
+    BackwardSweep();
+    void reset(const vector<OneAln>& backward, ULL len);    //!< for a read
+    void start(size_t backward_i, ULL y1);                  //!< for a forward alignment
+    void sweep(ULL x2, ULL y2);                             //!< for a pair
+};
+
+BackwardSweep::BackwardSweep():
+        backward(NULL), len(0), n_joined(0), first(0), y1(0), swept(0),
+        max_key_in(0), min_key_out(ULLONG_MAX), chainer(allowed_overlap),
+        min_start(ULLONG_MAX), max_end(0), total_cvg(0)
+{}
+
+void BackwardSweep::reset(const vector<OneAln>& backward, ULL len)
+{
+    this->backward = &backward;
+    this->len = len;
+    by_end.resize( backward.size() );
+    for(size_t b = 0; b < backward.size(); ++b)
+        by_end[b] = b;
+    stable_sort(by_end.begin(), by_end.end(), [&backward](size_t a, size_t b){
+                return backward[a].ref_end < backward[b].ref_end; });
+}
+
+void BackwardSweep::start(size_t backward_i, ULL y1)
+{
+    first = backward_i;
+    this->y1 = y1;
+    n_joined = 0;
+    keys.assign(backward->size(), ULLONG_MAX);
+    restart();
+}
+
+void BackwardSweep::restart()
+{
+    swept = first;
+    max_key_in = 0;
+    min_key_out = ULLONG_MAX;
+    chainer.clear();
+    update_best();
+}
+
+void BackwardSweep::update_best()
+{
+    if(chainer.empty())
+    {
+        min_start = ULLONG_MAX;
+        max_end = 0;
+        total_cvg = 0;
+        return;
+    }
+    total_cvg = chainer.score( chainer.best() );
+    chainer.ref_span(chainer.best(), min_start, max_end);
+}
+
+void BackwardSweep::sweep(ULL x2, ULL y2)
+{
+    const vector<OneAln>& bw = *backward;
+    ULL max_key = y2 + allowed_overlap;
+    bool is_changed = false;
+    for(; n_joined < by_end.size() && bw[ by_end[n_joined] ].ref_end < allowed_overlap + x2; ++n_joined)
+    {
+        size_t b = by_end[n_joined];
+        if(b < first || len - bw[b].qry_start + allowed_overlap < y1)
+            continue;
+        keys[b] = len - bw[b].qry_end;
+        if(b < swept)
+        {
+            if(keys[b] <= max_key)  is_changed = true;
+            else    min_key_out = min(min_key_out, keys[b]);
+        }
+    }
+    if(is_changed || max_key_in > max_key || min_key_out <= max_key)
+        restart();
+
+    // the alignments joined start before x2 + allowed_overlap
+    size_t last = upper_bound(bw.begin() + swept, bw.end(), x2 + allowed_overlap,
+            [](ULL x, const OneAln& aln){ return x < aln.ref_start; }) - bw.begin();
+    for(; swept < last; ++swept)
+    {
+        const OneAln& aln = bw[swept];
+        if(keys[swept] > max_key)
+        {
+            if(keys[swept] != ULLONG_MAX)
+                min_key_out = min(min_key_out, keys[swept]);
+            continue;
         }
+        max_key_in = max(max_key_in, keys[swept]);
+        chainer.add( riginv::ChainAnchor(aln.ref_start, aln.ref_end, aln.qry_start, aln.qry_end) );
     }
-    if(total_cvg == 0)  return;
-    if(total_cvg >= ((x2 - x1) + (y2 - y1)) * ptg1)
+    update_best();
+}
+
+/*========== functions ====================*/
+
+void save_inversion(ULL x1, ULL x2, ULL y1, ULL y2,
+        const BackwardSweep& swept, ofstream& fout)
+{
+    if(swept.total_cvg == 0)  return;
+    if(swept.total_cvg >= ((x2 - x1) + (y2 - y1)) * ptg1)
     {
+        ULL min_x = min(x2 + allowed_overlap, swept.min_start), max_x = swept.max_end;
         if(x1 > min_x)  swap(x1, min_x);
         if(max_x < x2)  swap(max_x, x2);
-        fout << x1 << ' ' << min_x << ' ' << x2 << ' ' << max_x << endl;
+        fout << x1 << ' ' << min_x << ' ' << x2 << ' ' << max_x << '\n';
     }
 }
 
@@ -108,24 +208,43 @@ bool abs_smallerthan_delta1(ULL x1, ULL x2, ULL y1, ULL y2)
     return (dx - dy <= delta1);
 }
 
-void type1_inversion(const vector<OneAln>& forward, const vector<OneAln>& backward, ofstream& fout, ULL len)
+/*! Both `forward` and `backward` are sorted by `ref_start`. For `i`, the `j` with
+ * `forward[j].ref_start <= forward[i].ref_end` are skipped by binary search, and those after
+ * `forward[i].ref_end + delta1 + max(qry_end) - forward[i].qry_end` cannot be within `delta1`
+ */
+void type1_inversion(const vector<OneAln>& forward, const vector<OneAln>& backward, ofstream& fout, ULL len,
+        BackwardSweep& swept)
 {
     size_t n = forward.size();
     size_t backward_i = 0;
+    ULL max_qry_end = 0;
+    for(size_t i = 0; i < n; ++i)
+        max_qry_end = max(max_qry_end, forward[i].qry_end);
+    swept.reset(backward, len);
     for(size_t i = 0; i < n; ++i)
     {
         backward_i = bi_move_right(forward[i].ref_end, backward, backward_i);
         if(backward_i >= backward.size())    return;
 
-        for(size_t j = i + 1; j < n; ++j)
+        ULL x1 = forward[i].ref_end, y1 = forward[i].qry_end;
+        ULL max_x2 = x1 + delta1 + (max_qry_end - y1);
+        size_t j = upper_bound(forward.begin() + i + 1, forward.end(), x1,
+                [](ULL x, const OneAln& aln){ return x < aln.ref_start; }) - forward.begin();
+        bool is_started = false;
+        for(; j < n && forward[j].ref_start <= max_x2; ++j)
         {
-            if(abs_smallerthan_delta1( forward[i].ref_end, forward[j].ref_start,
-                    forward[i].qry_end, forward[j].qry_end))
+            if(abs_smallerthan_delta1( x1, forward[j].ref_start,
+                    y1, forward[j].qry_end))
             {
-                save_inversion(forward[i].ref_end, forward[j].ref_start,
-                        forward[i].qry_end, forward[j].qry_start,
-                        backward, backward_i,
-                        fout, len);
+                if(!is_started)
+                {
+                    swept.start(backward_i, y1);
+                    is_started = true;
+                }
+                swept.sweep(forward[j].ref_start, forward[j].qry_start);
+                save_inversion(x1, forward[j].ref_start,
+                        y1, forward[j].qry_start,
+                        swept, fout);
             }
         }
     }
@@ -136,12 +255,16 @@ void do_analysis()
     ofstream fout;
     loon::open_file(fout, outfile);
     
+    BackwardSweep swept;
     size_t n = alns[0].size();
     for(size_t i = 0; i < n; ++i)
         if(alns[0][i].size() > 0 && alns[1][i].size() > 0)
         {
-            type1_inversion(alns[0][i], alns[1][i], fout, qry_lens[i]);
-            type1_inversion(alns[1][i], alns[0][i], fout, qry_lens[i]);
+            // already in the order of ref_start for a sorted input
+            stable_sort(alns[0][i].begin(), alns[0][i].end());
+            stable_sort(alns[1][i].begin(), alns[1][i].end());
+            type1_inversion(alns[0][i], alns[1][i], fout, qry_lens[i], swept);
+            type1_inversion(alns[1][i], alns[0][i], fout, qry_lens[i], swept);
         }
 
     fout.close();
@@ -149,38 +272,29 @@ void do_analysis()
 
 void read_alignments()
 {
-    ifstream fin;
-    loon::open_file(fin, infile);
+    riginv::BriefAlnReader reader(infile);
+    read_slots.reserve( reader.n_reads() );
 
     OneAln tmp;
-    ULL mapping_quality, qry_len;
-    string name;
-    string line;
-    char orientation;
-    map<string, size_t>::iterator it;
-    while(fin >> tmp.ref_start)
+    riginv::BriefAln aln;
+    while(reader.next( aln ))
     {
-        fin >> tmp.ref_end >> tmp.qry_start >> tmp.qry_end
-            >> name >> line >> qry_len >> mapping_quality >> orientation;
-        if(mapping_quality < min_MAPQ)
+        if(aln.mapq < min_MAPQ)
             continue;
-        it = alns_ids.find( name );
+        tmp.ref_start = aln.ref_start;
+        tmp.ref_end = aln.ref_end;
+        tmp.qry_start = aln.qry_start;
+        tmp.qry_end = aln.qry_end;
+        size_t slot = read_slots.insert( aln.read_id );
 
-        if(it == alns_ids.end())
+        if(slot == alns[0].size())
         {
-            alns_ids[ name ] = alns[0].size();
             alns[0].push_back( vector<OneAln>() );
             alns[1].push_back( vector<OneAln>() );
-            qry_lens.push_back( qry_len );
-            
-            alns[ orientation == 'R' ].back().push_back( tmp );
-        }
-        else
-        {
-            alns[ orientation == 'R' ][ it->second ].push_back( tmp );
+            qry_lens.push_back( aln.qry_len );
         }
+        alns[ aln.is_reverse ][ slot ].push_back( tmp );
     }
-    fin.close();
 }
 
 void parse_args(int argc, char* argv[])
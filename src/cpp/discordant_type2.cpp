@@ -2,11 +2,16 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <map>
 #include <algorithm>
+#include <deque>
+#include <memory>
+#include <future>
 #include <cstdlib>
 #include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
+#include <loonutil/numFormat.h>
+#include <loonutil/threadPool.h>
+#include <riginvutil/briefAlignment.h>
 
 using namespace std;
 
@@ -16,7 +21,7 @@ using namespace std;
 typedef unsigned long long ULL;
 typedef long long LL;
 class OneAln;
-class ReadAln;
+class ReadPiece;
 
 /*==================== command line args ====================*/
 char* infile;
@@ -26,9 +31,14 @@ LL ksi = 0;
 LL allowed_distance = 1000;
 LL min_extension = 100;
 LL allowed_overlap=50;
+bool adjacent_only = false;
+size_t n_threads = 1;
 
 /*==================== global variables ====================*/
-map<string, ReadAln > forward_reads, reverse_reads;
+riginv::ReadSlots read_slots;   // read ID -> slot
+vector<OneAln> alns;            // grouped by (slot, orientation), c.f. `group_alignments()`
+vector<size_t> group_offsets;   // the alignments of group `g = 2 * slot + is_reverse` are [group_offsets[g], group_offsets[g + 1])
+vector<LL> qry_lens;            // of each group
 
 /*==================== class OneAln ===================*/
 class OneAln
@@ -38,14 +48,40 @@ public:
     LL qry_start, qry_end;
 };
 
-class ReadAln: public vector<OneAln>
+//! An alignment of a read, by where it starts on the (forward) read
+class ReadPiece
 {
 public:
-    LL qry_len;
+    LL read_start;
+    const OneAln* aln;
+    bool is_reverse;
+public:
+    bool operator<(const ReadPiece& piece) const;
 };
 
+bool ReadPiece::operator<(const ReadPiece& piece) const
+{
+    return read_start < piece.read_start;
+}
+
+// A rectangle `x1 x2 y1 y2 <side><dist>`, where `side` is the rest of the line before the distance
+void append_rect(string& out, LL x1, LL x2, LL y1, LL y2, const char* side, LL dist)
+{
+    loon::append_int(out, x1);
+    out.push_back(' ');
+    loon::append_int(out, x2);
+    out.push_back(' ');
+    loon::append_int(out, y1);
+    out.push_back(' ');
+    loon::append_int(out, y2);
+    out.push_back(' ');
+    out.append(side);
+    loon::append_int(out, dist);
+    out.push_back('\n');
+}
+
 // TODO: can be changed to also output the corresponding reads
-void analyze_Lneighbor_covered(LL qlen, const OneAln& left_aln, const OneAln& right_aln, ofstream& fout)
+void analyze_Lneighbor_covered(LL qlen, const OneAln& left_aln, const OneAln& right_aln, string& out)
 {
     if(left_aln.ref_end + min_extension > right_aln.ref_end)  return;
     if(left_aln.qry_end + allowed_distance < qlen - right_aln.qry_end)  return;
@@ -58,25 +94,21 @@ void analyze_Lneighbor_covered(LL qlen, const OneAln& left_aln, const OneAln& ri
         if(left_aln.ref_end + min_extension > right_aln.ref_end - d)    return;
         if(d > allowed_overlap)    return;
 
-        fout << (left_aln.ref_end - d - ksi) << ' '
-            << (left_aln.ref_end + ksi) << ' '
-            << (right_aln.ref_end - d - ksi) << ' '
-            << (right_aln.ref_end + ksi) << ' '
-            << "[ -" << d << endl; // negative means the two alignment w.r.t. reads overlap
+        append_rect(out, left_aln.ref_end - d - ksi, left_aln.ref_end + ksi,
+                right_aln.ref_end - d - ksi, right_aln.ref_end + ksi,
+                "[ -", d); // negative means the two alignment w.r.t. reads overlap
     }
     else
     {
         LL d = qlen - right_aln.qry_end - left_aln.qry_end;
-        fout << (left_aln.ref_end - ksi) << ' '
-             << (left_aln.ref_end + d + ksi) << ' '
-             << (right_aln.ref_end - ksi) << ' '
-             << (right_aln.ref_end + d + ksi) << ' '
-             << " [ " << d << endl;
+        append_rect(out, left_aln.ref_end - ksi, left_aln.ref_end + d + ksi,
+                right_aln.ref_end - ksi, right_aln.ref_end + d + ksi,
+                " [ ", d);
     }
 }
 
 // TODO: can be changed to also output the corresponding reads
-void analyze_Rneighbor_covered(LL qlen, const OneAln& left_aln, const OneAln& right_aln, ofstream& fout)
+void analyze_Rneighbor_covered(LL qlen, const OneAln& left_aln, const OneAln& right_aln, string& out)
 {
     if(left_aln.ref_start + min_extension > right_aln.ref_start)    return;
     if(qlen - right_aln.qry_start + allowed_distance < left_aln.qry_start)    return;
@@ -88,87 +120,162 @@ void analyze_Rneighbor_covered(LL qlen, const OneAln& left_aln, const OneAln& ri
         if(right_aln.qry_end - right_aln.qry_start < d + min_extension) return;
         if(left_aln.ref_start + d + min_extension > right_aln.ref_start)    return;
         if(d > allowed_overlap)    return;
-        fout << (left_aln.ref_start - ksi) << ' '
-             << (left_aln.ref_start + d + ksi) << ' '
-             << (right_aln.ref_start - ksi) << ' '
-             << (right_aln.ref_start + d + ksi) << ' '
-             << "] -" << d << endl; // negative means the two alignments w.r.t. reads overlap
+        append_rect(out, left_aln.ref_start - ksi, left_aln.ref_start + d + ksi,
+                right_aln.ref_start - ksi, right_aln.ref_start + d + ksi,
+                "] -", d); // negative means the two alignments w.r.t. reads overlap
     }
     else
     {
         LL d = left_aln.qry_start - (qlen - right_aln.qry_start);
-        fout << (left_aln.ref_start - d - ksi) << ' '
-             << (left_aln.ref_start + ksi) << ' '
-             << (right_aln.ref_start - d - ksi) << ' '
-             << (right_aln.ref_start + ksi) << ' '
-             << "] " << d << endl;
+        append_rect(out, left_aln.ref_start - d - ksi, left_aln.ref_start + ksi,
+                right_aln.ref_start - d - ksi, right_aln.ref_start + ksi,
+                "] ", d);
+    }
+}
+
+void analyze_pair(LL qry_len, const OneAln& fwd_aln, const OneAln& rev_aln, string& out)
+{
+    analyze_Lneighbor_covered(qry_len, fwd_aln, rev_aln, out);
+    analyze_Lneighbor_covered(qry_len, rev_aln, fwd_aln, out);
+
+    analyze_Rneighbor_covered(qry_len, fwd_aln, rev_aln, out);
+    analyze_Rneighbor_covered(qry_len, rev_aln, fwd_aln, out);
+}
+
+/*! Only the pairs of a forward and a reverse alignment next to each other on the read are analyzed.
+ * The rectangles of a split read are from its F/R transitions, so the other pairs mostly repeat them.
+ */
+void analyze_adjacent(LL qry_len, const OneAln* fwd, const OneAln* rev, const OneAln* rev_end,
+        vector<ReadPiece>& pieces, string& out)
+{
+    pieces.clear();
+    for(const OneAln* aln = fwd; aln != rev; ++aln)
+        pieces.push_back( ReadPiece{aln->qry_start, aln, false} );
+    for(const OneAln* aln = rev; aln != rev_end; ++aln)
+        pieces.push_back( ReadPiece{qry_len - aln->qry_end, aln, true} );
+    stable_sort(pieces.begin(), pieces.end());
+    for(size_t k = 1; k < pieces.size(); ++k)
+    {
+        const ReadPiece& a = pieces[k - 1];
+        const ReadPiece& b = pieces[k];
+        if(a.is_reverse == b.is_reverse)    continue;
+        if(a.is_reverse)    analyze_pair(qry_len, *b.aln, *a.aln, out);
+        else    analyze_pair(qry_len, *a.aln, *b.aln, out);
+    }
+}
+
+// Analyze the reads of the slots [first, last) into `out`
+void analyze_reads(size_t first, size_t last, string& out)
+{
+    vector<ReadPiece> pieces;
+    for(size_t i = first; i < last; ++i)
+    {
+        const OneAln* fwd = alns.data() + group_offsets[2 * i];
+        const OneAln* rev = alns.data() + group_offsets[2 * i + 1];
+        const OneAln* rev_end = alns.data() + group_offsets[2 * i + 2];
+        if(fwd == rev || rev == rev_end)  continue;
+        LL qry_len = qry_lens[2 * i];
+
+        if(adjacent_only)
+        {
+            analyze_adjacent(qry_len, fwd, rev, rev_end, pieces, out);
+            continue;
+        }
+        for(const OneAln* aln_fit = fwd; aln_fit != rev; ++aln_fit)
+            for(const OneAln* aln_rit = rev; aln_rit != rev_end; ++aln_rit)
+                analyze_pair(qry_len, *aln_fit, *aln_rit, out);
     }
 }
 
-void do_analysis()
+// The blocks of reads are analyzed by `pool` (or by this thread without it), and their rectangles
+// are written in the order of the reads by this thread, so the output does not depend on the threads
+void do_analysis(loon::ThreadPool* pool)
 {
+    const size_t block_size = 4096;
+    const size_t max_inflight = pool == NULL ? 0 : pool->size() << 1;
+    const size_t n_reads = read_slots.size();
     ofstream fout;
     loon::open_file(fout, outfile);
-    for(map<string, ReadAln>::iterator fit = forward_reads.begin(); fit != forward_reads.end(); ++fit)
+    deque<pair<shared_ptr<string>, future<void> > > inflight;
+    string buffer;
+    for(size_t start = 0; start < n_reads || !inflight.empty(); )
     {
-        map<string, ReadAln>::iterator rit = reverse_reads.find( fit->first );
-        if(rit == reverse_reads.end())  continue;
-
-        // TODO: consider only adjacent alignments instead of ALL alignments
-        // sort(fit->second.begin(), fit->second.end());
-        // sort(rit->second.rbegin(), rit->second.rend());
-        for(vector<OneAln>::const_iterator aln_fit = fit->second.cbegin(); aln_fit != fit->second.cend(); ++aln_fit)
-            for(vector<OneAln>::const_iterator aln_rit = rit->second.cbegin(); aln_rit != rit->second.cend(); ++aln_rit)
-            {
-                analyze_Lneighbor_covered(fit->second.qry_len, *aln_fit, *aln_rit, fout);
-                analyze_Lneighbor_covered(fit->second.qry_len, *aln_rit, *aln_fit, fout);
-
-                analyze_Rneighbor_covered(fit->second.qry_len, *aln_fit, *aln_rit, fout);
-                analyze_Rneighbor_covered(fit->second.qry_len, *aln_rit, *aln_fit, fout);
-            }
+        if(pool == NULL)
+        {
+            buffer.clear();
+            analyze_reads(start, min(n_reads, start + block_size), buffer);
+            fout.write(buffer.data(), buffer.size());
+            start += block_size;
+            continue;
+        }
+        if(start < n_reads && inflight.size() < max_inflight)
+        {
+            shared_ptr<string> block = make_shared<string>();
+            size_t last = min(n_reads, start + block_size);
+            inflight.push_back( make_pair(block, pool->submit( [block, start, last](){
+                            analyze_reads(start, last, *block);
+                        } )) );
+            start = last;
+            continue;
+        }
+        inflight.front().second.get();
+        fout.write(inflight.front().first->data(), inflight.front().first->size());
+        inflight.pop_front();
     }
     fout.close();
 }
 
+/*! The alignments are read in the order of the input, with the group of each. A counting sort by
+ * the group then makes the alignments of a read contiguous, in their order of the input, by
+ * permuting them in place.
+ */
+void group_alignments(vector<size_t>& groups)
+{
+    size_t n_groups = 2 * read_slots.size();
+    group_offsets.assign(n_groups + 1, 0);
+    for(size_t k = 0; k < groups.size(); ++k)
+        ++group_offsets[ groups[k] + 1 ];
+    for(size_t g = 0; g < n_groups; ++g)
+        group_offsets[g + 1] += group_offsets[g];
+
+    // `groups` becomes the destination of each alignment
+    vector<size_t> next(group_offsets.begin(), group_offsets.end() - 1);
+    for(size_t k = 0; k < groups.size(); ++k)
+        groups[k] = next[ groups[k] ]++;
+    for(size_t k = 0; k < groups.size(); ++k)
+        while(groups[k] != k)
+        {
+            swap(alns[k], alns[ groups[k] ]);
+            swap(groups[k], groups[ groups[k] ]);
+        }
+}
+
 void read_alignments()
 {
-    ifstream fin;
-    loon::open_file(fin, infile);
+    riginv::BriefAlnReader reader(infile);
+    read_slots.reserve( reader.n_reads() );
 
+    vector<size_t> groups;
     OneAln tmp;
-    ULL mapping_quality;
-    LL qry_len;
-    string name, line, qry_name;
-    char orientation;
-    while(fin >> tmp.ref_start)
+    riginv::BriefAln aln;
+    while(reader.next( aln ))
     {
-        fin >> tmp.ref_end >> tmp.qry_start >> tmp.qry_end
-            >> qry_name >> line >> qry_len >> mapping_quality >> orientation;
-        if(mapping_quality < min_MAPQ)
+        if(aln.mapq < min_MAPQ)
             continue;
-        map<string, ReadAln>::iterator it;
-        if(orientation == 'F')
-        {
-            it = forward_reads.find( qry_name );
-            if(it == forward_reads.end())
-            {
-                forward_reads[ qry_name ].qry_len = qry_len;
-                it = forward_reads.find( qry_name );
-            }
-        }
-        else
-        {
-            it = reverse_reads.find( qry_name );
-            if(it == reverse_reads.end())
-            {
-                reverse_reads[ qry_name ].qry_len = qry_len;
-                it = reverse_reads.find( qry_name );
-            }
-        }
-        it->second.push_back( tmp );
+        tmp.ref_start = aln.ref_start;
+        tmp.ref_end = aln.ref_end;
+        tmp.qry_start = aln.qry_start;
+        tmp.qry_end = aln.qry_end;
+        size_t slot = read_slots.insert( aln.read_id );
+        if(2 * slot == qry_lens.size())
+            qry_lens.resize(2 * slot + 2, -1);
+        size_t group = 2 * slot + aln.is_reverse;
+        if(qry_lens[group] < 0)
+            qry_lens[group] = aln.qry_len;
+        alns.push_back( tmp );
+        groups.push_back( group );
     }
-
-    fin.close();
+    group_alignments(groups);
 }
 
 void parse_args(int argc, char* argv[])
@@ -181,6 +288,8 @@ void parse_args(int argc, char* argv[])
     help.add_argument("min_extension: Minimum extended length when two split reads overlap");
     help.add_argument("Ksi: Allowed error for assessing break points");
     help.add_argument("Maximum allowed distance between adjacent aligned piece of the reads");
+    help.add_flag("--adjacent", "Only analyze the forward and reverse alignments next to each other on the read, instead of all the pairs");
+    help.add_option("-t", "Number of threads to analyze the reads", "1");
 
     help.check(argc, argv);
 
@@ -190,12 +299,17 @@ void parse_args(int argc, char* argv[])
     min_extension = stoull(argv[4]);
     ksi = stoull(argv[5]);
     allowed_distance = stoull(argv[6]);
+    adjacent_only = help.is_set("--adjacent");
+    n_threads = max<size_t>(stoull( help.get_option("-t") ), 1);
 }
 
 int main(int argc, char* argv[])
 {
     parse_args(argc, argv);
     read_alignments();
-    do_analysis();
+    unique_ptr<loon::ThreadPool> pool;
+    if(n_threads > 1)
+        pool.reset( new loon::ThreadPool(n_threads) );
+    do_analysis( pool.get() );
     return 0;
 }
@@ -2,10 +2,10 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <map>
 #include <cstdlib>
 #include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
+#include <riginvutil/briefAlignment.h>
 
 using namespace std;
 
@@ -25,8 +25,9 @@ LL ksi = 0;
 
 /*==================== globals variables  ====================*/
 vector<OneAln> alns[2];
-map<string, LL> qry_lens;
-map<string, vector<OneAln*>* > forward_reads[2], reverse_reads[2];
+riginv::ReadDict read_dict;     // shared by both input files, unless they have the read IDs of their run
+vector<LL> qry_lens;            // indexed by the read IDs
+vector<vector<OneAln*>* > forward_reads[2], reverse_reads[2];   // indexed by the read IDs. NULL if there is no alignment
 
 /*==================== class OneAln ====================*/
 class OneAln
@@ -34,12 +35,17 @@ class OneAln
 public:
     LL ref_start, ref_end;
     LL qry_start, qry_end;
-    string qry_name;
+    unsigned int read_id;
     char orientation;
 };
 
 /*==================== functions  ====================*/
 
+vector<OneAln*>* read_alns(const vector<vector<OneAln*>* >& reads, unsigned int read_id)
+{
+    return read_id < reads.size() ? reads[read_id] : NULL;
+}
+
 // 1) ref: F F ; [ ]
 void analyze_ref_FF(const OneAln& A_L, const OneAln& A_R, LL A_len,
         const OneAln& B_L, const OneAln& B_R, LL B_len,
@@ -143,8 +149,8 @@ void analyze_ref_RR(const OneAln& A_L, const OneAln& A_R, LL A_len,
 void do_analysis()
 {
     size_t n1 = alns[0].size();
-    map<string, vector<OneAln*>*>::iterator A_R_forward_it, A_R_reverse_it,
-                                            B_R_forward_it, B_R_reverse_it;
+    vector<OneAln*> *A_R_forward, *A_R_reverse,
+                    *B_R_forward, *B_R_reverse;
     ofstream fout_FF, fout_FR, fout_RF, fout_RR;
     loon::open_file(fout_FF, string(outfile_prefix) + string("_FF"));
     loon::open_file(fout_FR, string(outfile_prefix) + string("_FR"));
@@ -152,35 +158,35 @@ void do_analysis()
     loon::open_file(fout_RR, string(outfile_prefix) + string("_RR"));
     for(size_t A_L = 0; A_L < n1; ++A_L)
     {
-        A_R_forward_it = forward_reads[1].find( alns[0][A_L].qry_name );
-        A_R_reverse_it = reverse_reads[1].find( alns[0][A_L].qry_name );
+        A_R_forward = read_alns(forward_reads[1], alns[0][A_L].read_id);
+        A_R_reverse = read_alns(reverse_reads[1], alns[0][A_L].read_id);
 
-        if(A_R_forward_it == forward_reads[1].end() && A_R_reverse_it == reverse_reads[1].end())
+        if(A_R_forward == NULL && A_R_reverse == NULL)
             continue;
 
-        LL A_len = qry_lens[ alns[0][A_L].qry_name ];
+        LL A_len = qry_lens[ alns[0][A_L].read_id ];
 
         for(size_t B_L = A_L + 1; B_L < n1; ++B_L)
         {
-            if(alns[0][ A_L ].qry_name == alns[0][ B_L ].qry_name)
+            if(alns[0][ A_L ].read_id == alns[0][ B_L ].read_id)
                 continue;
-            B_R_forward_it = forward_reads[1].find( alns[0][B_L].qry_name );
-            B_R_reverse_it = reverse_reads[1].find( alns[0][B_L].qry_name );
+            B_R_forward = read_alns(forward_reads[1], alns[0][B_L].read_id);
+            B_R_reverse = read_alns(reverse_reads[1], alns[0][B_L].read_id);
 
-            if(B_R_forward_it == forward_reads[1].end() && B_R_reverse_it == reverse_reads[1].end())
+            if(B_R_forward == NULL && B_R_reverse == NULL)
                 continue;
 
-            LL B_len = qry_lens[ alns[0][B_L].qry_name ];
+            LL B_len = qry_lens[ alns[0][B_L].read_id ];
 
-            if(A_R_forward_it != forward_reads[1].end())
+            if(A_R_forward != NULL)
             {
-                for(vector<OneAln*>::iterator A_R_pit = A_R_forward_it->second->begin();
-                        A_R_pit != A_R_forward_it->second->end(); ++A_R_pit)
+                for(vector<OneAln*>::iterator A_R_pit = A_R_forward->begin();
+                        A_R_pit != A_R_forward->end(); ++A_R_pit)
                 {// a: - f
-                    if(B_R_forward_it != forward_reads[1].end())
+                    if(B_R_forward != NULL)
                     {
-                        for(vector<OneAln*>::iterator B_R_pit = B_R_forward_it->second->begin();
-                                B_R_pit != B_R_forward_it->second->end(); ++B_R_pit)
+                        for(vector<OneAln*>::iterator B_R_pit = B_R_forward->begin();
+                                B_R_pit != B_R_forward->end(); ++B_R_pit)
                         {// a: - f;  b: - f
                             if(alns[0][A_L].orientation == 'F')
                             {// a: f f; b: - f
@@ -215,10 +221,10 @@ void do_analysis()
                         }
                     }
 
-                    if(B_R_reverse_it != reverse_reads[1].end())
+                    if(B_R_reverse != NULL)
                     {
-                        for(vector<OneAln*>::iterator B_R_pit = B_R_reverse_it->second->begin();
-                                B_R_pit != B_R_reverse_it->second->end(); ++B_R_pit)
+                        for(vector<OneAln*>::iterator B_R_pit = B_R_reverse->begin();
+                                B_R_pit != B_R_reverse->end(); ++B_R_pit)
                         {// a: - f;  b: - r
                             if(alns[0][A_L].orientation == 'F')
                             {// a: f f;  b: - r
@@ -254,15 +260,15 @@ void do_analysis()
                     }
                 }
             }
-            if(A_R_reverse_it != reverse_reads[1].end())
+            if(A_R_reverse != NULL)
             {
-                for(vector<OneAln*>::iterator A_R_pit = A_R_reverse_it->second->begin();
-                        A_R_pit != A_R_reverse_it->second->end(); ++A_R_pit)
+                for(vector<OneAln*>::iterator A_R_pit = A_R_reverse->begin();
+                        A_R_pit != A_R_reverse->end(); ++A_R_pit)
                 {// a: - r
-                    if(B_R_forward_it != forward_reads[1].end())
+                    if(B_R_forward != NULL)
                     {
-                        for(vector<OneAln*>::iterator B_R_pit = B_R_forward_it->second->begin();
-                                B_R_pit != B_R_forward_it->second->end(); ++B_R_pit)
+                        for(vector<OneAln*>::iterator B_R_pit = B_R_forward->begin();
+                                B_R_pit != B_R_forward->end(); ++B_R_pit)
                         {// a: - r;  b: - f
                             if(alns[0][A_L].orientation == 'F')
                             {// a: f r;  b: - f
@@ -297,10 +303,10 @@ void do_analysis()
                         }
                     }
 
-                    if(B_R_reverse_it != reverse_reads[1].end())
+                    if(B_R_reverse != NULL)
                     {
-                        for(vector<OneAln*>::iterator B_R_pit = B_R_reverse_it->second->begin();
-                                B_R_pit != B_R_reverse_it->second->end(); ++B_R_pit)
+                        for(vector<OneAln*>::iterator B_R_pit = B_R_reverse->begin();
+                                B_R_pit != B_R_reverse->end(); ++B_R_pit)
                         {// a: - r; b: - r
                             if(alns[0][A_L].orientation == 'F')
                             {// a: f r;  b: - r
@@ -344,60 +350,49 @@ void do_analysis()
     fout_RR.close();
 }
 
-void read_alignment(char* fname, vector<OneAln>& alignments,
-        map<string, vector<OneAln*>*>& fwd_reads, 
-        map<string, vector<OneAln*>*>& rev_reads)
+void add_read_aln(vector<vector<OneAln*>* >& reads, OneAln* aln)
+{
+    if(aln->read_id >= reads.size())
+        reads.resize(aln->read_id + 1, NULL);
+    if(reads[ aln->read_id ] == NULL)
+        reads[ aln->read_id ] = new vector<OneAln*>();
+    reads[ aln->read_id ]->push_back( aln );
+}
+
+void read_alignment(riginv::BriefAlnReader& reader, vector<OneAln>& alignments,
+        vector<vector<OneAln*>* >& fwd_reads,
+        vector<vector<OneAln*>* >& rev_reads)
 {
-    ifstream fin;
-    loon::open_file(fin, fname);
-    
     OneAln tmp;
-    ULL mapping_quality;
-    LL qry_len;
-    string name;
-    string line;
-    while(fin >> tmp.ref_start)
+    riginv::BriefAln aln;
+    while(reader.next( aln ))
     {
-        fin >> tmp.ref_end >> tmp.qry_start >> tmp.qry_end
-            >> tmp.qry_name >> line >> qry_len >> mapping_quality >> tmp.orientation;
-        if(mapping_quality < min_MAPQ)
+        if(aln.mapq < min_MAPQ)
             continue;
+        tmp.ref_start = aln.ref_start;
+        tmp.ref_end = aln.ref_end;
+        tmp.qry_start = aln.qry_start;
+        tmp.qry_end = aln.qry_end;
+        tmp.read_id = aln.read_id;
+        tmp.orientation = aln.orientation();
         alignments.push_back( tmp );
-        qry_lens[ tmp.qry_name ] = qry_len;
+        if(aln.read_id >= qry_lens.size())
+            qry_lens.resize(aln.read_id + 1, 0);
+        qry_lens[ aln.read_id ] = aln.qry_len;
     }
-    map<string, vector<OneAln*>*>::iterator it;
     for(size_t i = 0; i < alignments.size(); ++i)
     {
         if(alignments[i].orientation == 'F')
-        {
-            it = fwd_reads.find( alignments[i].qry_name );
-            if(it == fwd_reads.end())
-            {
-                fwd_reads[ alignments[i].qry_name ] = new vector<OneAln*>();
-                it = fwd_reads.find( alignments[i].qry_name );
-            }
-            it->second->push_back( &alignments[i] );
-        }
+            add_read_aln(fwd_reads, &alignments[i]);
         else
-        {
-            it = rev_reads.find( alignments[i].qry_name );
-            if(it == rev_reads.end())
-            {
-                rev_reads[ alignments[i].qry_name ] = new vector<OneAln*>();
-                it = rev_reads.find( alignments[i].qry_name );
-            }
-            it->second->push_back( &alignments[i] );
-        }
+            add_read_aln(rev_reads, &alignments[i]);
     }
-
-    fin.close();
 }
 
-void deallocate_maps(map<string, vector<OneAln*>*>& reads)
+void deallocate_maps(vector<vector<OneAln*>* >& reads)
 {
-    for(map<string, vector<OneAln*>*>::iterator it = reads.begin();
-            it != reads.end(); ++it)
-        delete it->second;
+    for(vector<vector<OneAln*>* >::iterator it = reads.begin(); it != reads.end(); ++it)
+        delete (*it);
 }
 
 void parse_args(int argc, char* argv[])
@@ -425,8 +420,11 @@ void parse_args(int argc, char* argv[])
 int main(int argc, char* argv[])
 {
     parse_args(argc, argv);
-    read_alignment(infile[0], alns[0], forward_reads[0], reverse_reads[0]);
-    read_alignment(infile[1], alns[0], forward_reads[1], reverse_reads[1]);
+    riginv::BriefAlnReader reader0(infile[0], &read_dict), reader1(infile[1], &read_dict);
+    if(reader0.has_global_ids() != reader1.has_global_ids())
+        throw loon::Exception(5, "Read IDs of [%s] and [%s] are not comparable. Convert them to the same format first", infile[0], infile[1]);
+    read_alignment(reader0, alns[0], forward_reads[0], reverse_reads[0]);
+    read_alignment(reader1, alns[0], forward_reads[1], reverse_reads[1]);
 
     do_analysis();
 
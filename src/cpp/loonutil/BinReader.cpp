@@ -37,6 +37,11 @@ unsigned long long BinReader::file_size()
     return ret;
 }
 
+bool BinReader::good() const
+{
+    return fin.good();
+}
+
 long long BinReader::read_int()
 {
     unsigned long long ret = 0;
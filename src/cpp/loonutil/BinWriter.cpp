@@ -287,7 +287,7 @@ void BinWriter::write_uint64(const unsigned long long* num, size_t n)
 
 void BinWriter::write_uint64(const std::vector<unsigned long long>& num)
 {
-    fout.write(reinterpret_cast<const char*>(num.data()), num.size() << 1);
+    fout.write(reinterpret_cast<const char*>(num.data()), num.size() << 3);
 }
 
 void BinWriter::write_size_t(size_t num)
@@ -104,6 +104,7 @@ public:
     void close();
     void seek(size_t offset);
     unsigned long long file_size();
+    bool good() const;//!< false if the last read hit the end of the file or failed
 
     long long read_int();
     void read_int(char *num, size_t n);
@@ -0,0 +1,91 @@
+#ifndef __LOONUTIL_LOSER_TREE_H
+#define __LOONUTIL_LOSER_TREE_H
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+namespace loon
+{
+
+/*! \ingroup Class_util
+ * \brief Tournament tree of losers for a k-way merge
+ *
+ * The tree orders `k` sources by their current heads, which are compared by `less(a, b)`
+ * for the source indices `a` and `b`. Equal heads are taken from the source with the smaller
+ * index first, so merging the sorted runs of an input in the order of the runs is stable.
+ *
+ * After the head of top() is taken, the caller either advances that source and calls replay(),
+ * or calls finish() if the source is exhausted. Each of them costs `log2(k)` comparisons.
+ */
+template<class Less>
+class LoserTree
+{
+private:
+    size_t k;
+    std::vector<size_t> losers;     // losers[0] is the winner
+    std::vector<bool> finished;
+    Less less;
+
+    bool beats(size_t a, size_t b) const
+    {
+        if(finished[a]) return false;
+        if(finished[b]) return true;
+        if(less(a, b))  return true;
+        if(less(b, a))  return false;
+        return a < b;
+    }
+
+    // nodes [1, k) are internal, and node k + i is the leaf of source i
+    size_t build(size_t node)
+    {
+        if(node >= k)
+            return node - k;
+        size_t left = build(node << 1);
+        size_t right = build((node << 1) + 1);
+        bool left_wins = beats(left, right);
+        losers[node] = left_wins ? right : left;
+        return left_wins ? left : right;
+    }
+public:
+    LoserTree(size_t k, const Less& less):
+            k(k), losers(k == 0 ? 1 : k, 0), finished(k, false), less(less)
+    {}
+
+    //! The heads of all the sources are loaded. `finished` marks the empty sources
+    void init(const std::vector<bool>& is_empty)
+    {
+        finished = is_empty;
+        if(k > 0)
+            losers[0] = build(1);
+    }
+
+    bool empty() const
+    {
+        return k == 0 || finished[ losers[0] ];
+    }
+
+    size_t top() const
+    {
+        return losers[0];
+    }
+
+    void replay()
+    {
+        size_t winner = losers[0];
+        for(size_t node = (winner + k) >> 1; node > 0; node >>= 1)
+            if(beats(losers[node], winner))
+                std::swap(losers[node], winner);
+        losers[0] = winner;
+    }
+
+    void finish()
+    {
+        finished[ losers[0] ] = true;
+        replay();
+    }
+};
+
+}// namespace loon
+
+#endif
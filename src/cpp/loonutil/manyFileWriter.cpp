@@ -0,0 +1,187 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "exception.h"
+#include "manyFileWriter.h"
+
+namespace loon
+{
+
+ManyFileWriter::ManyFileWriter(size_t max_open_files/* = 512 */, size_t buffer_size/* = 1048576 */, size_t memory_budget/* = 268435456 */):
+        max_open_files(max_open_files == 0 ? 1 : max_open_files), buffer_size(buffer_size),
+        memory_budget(memory_budget), total_buffered(0)
+{}
+
+ManyFileWriter::~ManyFileWriter()
+{
+    // errors can't be reported from a destructor, so only the descriptors are closed
+    for(std::list<size_t>::iterator it = open_fds.begin(); it != open_fds.end(); ++it)
+        ::close(files[*it].fd);
+}
+
+size_t ManyFileWriter::add_file(const std::string& fname)
+{
+    files.push_back( File() );
+    File& f = files.back();
+    f.fname = fname;
+    f.offset = 0;
+    f.fd = -1;
+    f.created = false;
+    f.closed = false;
+    f.is_buffered = false;
+    return files.size() - 1;
+}
+
+size_t ManyFileWriter::size() const
+{
+    return files.size();
+}
+
+const std::string& ManyFileWriter::file_name(size_t file) const
+{
+    return files[file].fname;
+}
+
+void ManyFileWriter::open_fd(size_t file)
+{
+    File& f = files[file];
+    if(f.fd >= 0)
+    {// move to the front of the LRU list
+        open_fds.splice(open_fds.begin(), open_fds, f.fd_pos);
+        return;
+    }
+    if(open_fds.size() >= max_open_files)
+        close_fd( open_fds.back() );
+    int flags = O_WRONLY | O_CREAT | (f.created ? 0 : O_TRUNC);
+    f.fd = ::open(f.fname.c_str(), flags, 0644);
+    if(f.fd < 0)
+        throw Exception(2, "Cannot open file [%s]", f.fname.c_str());
+    f.created = true;
+    open_fds.push_front(file);
+    f.fd_pos = open_fds.begin();
+}
+
+void ManyFileWriter::close_fd(size_t file)
+{
+    File& f = files[file];
+    if(f.fd < 0)    return;
+    open_fds.erase(f.fd_pos);
+    if(::close(f.fd) != 0)
+        throw Exception(2, "Cannot close file [%s]", f.fname.c_str());
+    f.fd = -1;
+}
+
+// Write the buffer of `file` followed by `data`, and empty the buffer
+void ManyFileWriter::write_out(size_t file, const char* data, size_t n)
+{
+    File& f = files[file];
+    if(f.buffer.empty() && n == 0 && f.created)   return;
+    open_fd(file);
+    struct iovec iov[2];
+    int n_iov = 0;
+    if(!f.buffer.empty())
+    {
+        iov[n_iov].iov_base = &f.buffer[0];
+        iov[n_iov++].iov_len = f.buffer.size();
+    }
+    if(n > 0)
+    {
+        iov[n_iov].iov_base = const_cast<char*>(data);
+        iov[n_iov++].iov_len = n;
+    }
+    while(n_iov > 0)
+    {
+        ssize_t written = pwritev(f.fd, iov, n_iov, static_cast<off_t>(f.offset));
+        if(written < 0)
+        {
+            if(errno == EINTR)  continue;
+            throw Exception(2, "Cannot write to file [%s]", f.fname.c_str());
+        }
+        f.offset += written;
+        // skip the bytes that have been written
+        size_t left = written;
+        int first = 0;
+        while(first < n_iov && left >= iov[first].iov_len)
+            left -= iov[first++].iov_len;
+        for(int i = first; i < n_iov; ++i)
+            iov[i - first] = iov[i];
+        n_iov -= first;
+        if(n_iov > 0)
+        {
+            iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + left;
+            iov[0].iov_len -= left;
+        }
+    }
+    total_buffered -= f.buffer.size();
+    f.buffer.clear();
+    if(f.is_buffered)
+    {
+        buffered.erase(f.buffer_pos);
+        f.is_buffered = false;
+    }
+}
+
+void ManyFileWriter::release_buffer(size_t file)
+{
+    write_out(file, NULL, 0);
+    std::string().swap(files[file].buffer);
+}
+
+void ManyFileWriter::enforce_budget()
+{
+    if(total_buffered <= memory_budget) return;
+    while(!buffered.empty() && total_buffered > (memory_budget >> 1))
+        release_buffer( buffered.back() );
+}
+
+void ManyFileWriter::write(size_t file, const char* data, size_t n)
+{
+    File& f = files[file];
+    if(f.closed)
+        throw Exception(2, "File [%s] has been closed", f.fname.c_str());
+    if(f.buffer.size() + n > buffer_size)
+    {
+        write_out(file, data, n);
+        return;
+    }
+    if(n == 0)  return;
+    f.buffer.append(data, n);
+    total_buffered += n;
+    if(f.is_buffered)
+        buffered.splice(buffered.begin(), buffered, f.buffer_pos);
+    else
+    {
+        buffered.push_front(file);
+        f.buffer_pos = buffered.begin();
+        f.is_buffered = true;
+    }
+    enforce_budget();
+}
+
+void ManyFileWriter::write(size_t file, const std::string& data)
+{
+    write(file, data.data(), data.size());
+}
+
+void ManyFileWriter::flush(size_t file)
+{
+    write_out(file, NULL, 0);
+}
+
+void ManyFileWriter::close(size_t file)
+{
+    File& f = files[file];
+    if(f.closed)    return;
+    release_buffer(file);
+    close_fd(file);
+    f.closed = true;
+}
+
+void ManyFileWriter::close_all()
+{
+    for(size_t i = 0; i < files.size(); ++i)
+        close(i);
+}
+
+}// namespace loon
@@ -0,0 +1,77 @@
+#ifndef __LOONUTIL_MANY_FILE_WRITER_H
+#define __LOONUTIL_MANY_FILE_WRITER_H
+
+#include <string>
+#include <vector>
+#include <list>
+
+namespace loon
+{
+
+/*! \ingroup Class_util
+ * \brief Write to many files with a bounded number of open file descriptors
+ *
+ * Each file buffers at most `buffer_size` bytes. When a buffer would overflow, the buffered
+ * bytes and the incoming bytes are written by one `pwritev()` at the offset tracked for the
+ * file, so a file never needs to be reopened in append mode.
+ *
+ * At most `max_open_files` descriptors are open; the least recently used one is closed
+ * when another is needed. If all the files buffer more than `memory_budget` bytes, the least
+ * recently written buffers are flushed and released until half of the budget is used.
+ *
+ * A file is created (or truncated) when its first bytes are flushed. Files without any
+ * bytes are created by close().
+ */
+class ManyFileWriter
+{
+private:
+    class File
+    {
+    public:
+        std::string fname;
+        std::string buffer;
+        unsigned long long offset;  // bytes on the disk
+        int fd;
+        bool created;
+        bool closed;
+        std::list<size_t>::iterator fd_pos;     // in `open_fds`
+        std::list<size_t>::iterator buffer_pos; // in `buffered`
+        bool is_buffered;
+    };
+
+    std::vector<File> files;
+    std::list<size_t> open_fds;     // most recently used first
+    std::list<size_t> buffered;     // files with buffered bytes, most recently written first
+    size_t max_open_files;
+    size_t buffer_size;
+    size_t memory_budget;
+    size_t total_buffered;
+
+    void open_fd(size_t file);
+    void close_fd(size_t file);
+    void write_out(size_t file, const char* data, size_t n);
+    void release_buffer(size_t file);
+    void enforce_budget();
+public:
+    /*! \brief Constructor
+     *
+     * \param [in] max_open_files Maximum number of file descriptors open at the same time
+     * \param [in] buffer_size Maximum number of bytes buffered for each file
+     * \param [in] memory_budget Maximum number of bytes buffered for all the files
+     */
+    ManyFileWriter(size_t max_open_files = 512, size_t buffer_size = 1048576, size_t memory_budget = 268435456);
+    ~ManyFileWriter();
+
+    size_t add_file(const std::string& fname);  //!< \return The handle of the file for the other member functions
+    size_t size() const;                        //!< Number of files added
+    const std::string& file_name(size_t file) const;
+    void write(size_t file, const char* data, size_t n);
+    void write(size_t file, const std::string& data);
+    void flush(size_t file);
+    void close(size_t file);    //!< flush the file and close its descriptor. The file cannot be written any more
+    void close_all();
+};
+
+}// namespace loon
+
+#endif
@@ -0,0 +1,122 @@
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "exception.h"
+#include "mappedTextReader.h"
+
+namespace loon
+{
+
+MappedTextReader::MappedTextReader():
+        data(NULL), pos(NULL), end(NULL), released(NULL), length(0)
+{}
+
+MappedTextReader::MappedTextReader(const std::string& fname):
+        data(NULL), pos(NULL), end(NULL), released(NULL), length(0)
+{
+    open(fname);
+}
+
+MappedTextReader::~MappedTextReader()
+{
+    close();
+}
+
+void MappedTextReader::open(const std::string& fname)
+{
+    close();
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw Exception(1, "Cannot open file [%s]", fname.c_str());
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        throw Exception(1, "Cannot open file [%s]", fname.c_str());
+    }
+    length = st.st_size;
+    if(length > 0)
+    {
+        void* addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr == MAP_FAILED)
+        {
+            ::close(fd);
+            throw Exception(1, "Cannot map file [%s]", fname.c_str());
+        }
+        madvise(addr, length, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(addr);
+    }
+    else    // an empty file can't be mapped
+        data = "";
+    ::close(fd);
+    pos = released = data;
+    end = data + length;
+}
+
+void MappedTextReader::close()
+{
+    if(data != NULL && length > 0)
+        munmap(const_cast<char*>(data), length);
+    data = pos = end = released = NULL;
+    length = 0;
+}
+
+bool MappedTextReader::is_open() const
+{
+    return data != NULL;
+}
+
+bool MappedTextReader::eof()
+{
+    return !skip_space();
+}
+
+void MappedTextReader::release(size_t min_bytes/* = 0 */)
+{
+    if(length == 0 || static_cast<size_t>(pos - released) < min_bytes)
+        return;
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t start = released - data;     // page aligned
+    size_t stop = (pos - data) / page_size * page_size;
+    if(stop <= start)   return;
+    madvise(const_cast<char*>(data) + start, stop - start, MADV_DONTNEED);
+    released = data + stop;
+}
+
+bool MappedTextReader::read_token(std::string& token)
+{
+    const char* p;
+    size_t len;
+    if(!read_token(p, len)) return false;
+    token.assign(p, len);
+    return true;
+}
+
+bool MappedTextReader::skip_token()
+{
+    const char* p;
+    size_t len;
+    return read_token(p, len);
+}
+
+bool MappedTextReader::read_line(const char*& line, size_t& len)
+{
+    if(pos >= end)  return false;
+    line = pos;
+    const char* newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+    if(newline == NULL)
+    {
+        pos = end;
+        len = end - line;
+    }
+    else
+    {
+        len = newline - line;
+        pos = newline + 1;
+    }
+    return true;
+}
+
+}// namespace loon
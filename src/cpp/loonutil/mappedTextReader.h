@@ -0,0 +1,142 @@
+#ifndef __LOONUTIL_MAPPED_TEXT_READER_H
+#define __LOONUTIL_MAPPED_TEXT_READER_H
+
+#include <string>
+
+namespace loon
+{
+
+/*! \ingroup Class_util
+ * \brief Scanner of a memory-mapped text file
+ *
+ * A locale-free replacement of `std::ifstream` and `operator>>` for the whitespace separated
+ * text files. The file is mapped with `MADV_SEQUENTIAL`, and the tokens are returned as
+ * pointers into the mapping, so nothing is copied.
+ *
+ * As with `operator>>`, each read_*() skips the leading whitespace, and returns false
+ * (without consuming the token) if the next token cannot be read. read_unsigned() also
+ * accepts a sign, and a negative number wraps around. Overflows are not checked.
+ *
+ * The scanners are inline, as they are called for every field.
+ */
+class MappedTextReader
+{
+private:
+    const char* data;
+    const char* pos;
+    const char* end;
+    const char* released;   // the pages before this are released by release()
+    size_t length;
+
+    // the same characters as isspace() in the "C" locale
+    static bool is_space(char c)
+    {
+        return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+    }
+
+    bool skip_space()   //!< false at the end of the file
+    {
+        const char* p = pos;
+        while(p < end && is_space(*p))
+            ++p;
+        pos = p;
+        return p < end;
+    }
+
+    // A negative number wraps around, as `operator>>` (and strtoull()) does for the unsigned types
+    bool scan_unsigned(unsigned long long& num)
+    {
+        if(!skip_space())   return false;
+        const char* p = pos;
+        const char* e = end;
+        bool negative = (*p == '-');
+        if(negative || *p == '+')   ++p;
+        unsigned int digit;
+        if(p == e || (digit = static_cast<unsigned char>(*p - '0')) > 9)
+            return false;   // the sign has to be followed by the digits
+        unsigned long long ret = digit;
+        while(++p < e && (digit = static_cast<unsigned char>(*p - '0')) <= 9)
+            ret = ret * 10 + digit;
+        num = negative ? 0ULL - ret : ret;
+        pos = p;
+        return true;
+    }
+
+    bool scan_signed(long long& num)
+    {
+        unsigned long long ret;
+        if(!scan_unsigned(ret)) return false;
+        num = static_cast<long long>(ret);
+        return true;
+    }
+public:
+    MappedTextReader();
+    explicit MappedTextReader(const std::string& fname);
+    ~MappedTextReader();
+    MappedTextReader(const MappedTextReader&) = delete;
+    MappedTextReader& operator=(const MappedTextReader&) = delete;
+
+    void open(const std::string& fname);
+    void close();
+    bool is_open() const;
+    bool eof();     //!< true if only whitespace is left
+
+    /*! \brief Drop the pages before the current position from the memory, if at least `min_bytes`
+     * were read since the last release
+     *
+     * This keeps the resident memory of a large file bounded. The pointers returned before are
+     * still valid: the pages are read from the file again if they are accessed.
+     */
+    void release(size_t min_bytes = 0);
+
+    template<class T>
+    bool read_unsigned(T& num)
+    {
+        unsigned long long ret;
+        if(!scan_unsigned(ret)) return false;
+        num = static_cast<T>(ret);
+        return true;
+    }
+
+    template<class T>
+    bool read_signed(T& num)
+    {
+        long long ret;
+        if(!scan_signed(ret))   return false;
+        num = static_cast<T>(ret);
+        return true;
+    }
+
+    bool read_char(char& c)     //!< the next non-whitespace character
+    {
+        if(!skip_space())   return false;
+        c = *pos++;
+        return true;
+    }
+
+    bool read_token(const char*& token, size_t& len)    //!< `token` points into the mapping
+    {
+        if(!skip_space())   return false;
+        const char* p = pos;
+        const char* e = end;
+        token = p;
+        while(p < e && !is_space(*p))
+            ++p;
+        len = p - token;
+        pos = p;
+        return true;
+    }
+
+    bool read_token(std::string& token);
+    bool skip_token();
+
+    /*! \brief The rest of the current line, without the '\n'
+     *
+     * Unlike the other read_*(), the leading whitespace is kept. False at the end of the file.
+     */
+    bool read_line(const char*& line, size_t& len);
+};
+
+}// namespace loon
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __LOONUTIL_NUM_FORMAT_H
+#define __LOONUTIL_NUM_FORMAT_H
+
+#include <string>
+#include <cstring>
+
+namespace loon
+{
+/*!\ingroup Func_util
+ * @{
+ */
+
+/*! \brief Write the decimal representation of an unsigned integer
+ *
+ * A locale-free replacement of `operator<<` for integers. Two digits are produced
+ * per step by a lookup table.
+ *
+ * \param [out] buf The buffer to write to. It should have at least 20 bytes available.
+ * \param [in] num The integer to be formatted.
+ * \return The number of characters written (no trailing '\0').
+ */
+inline size_t format_uint(char* buf, unsigned long long num)
+{
+    static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char tmp[20];
+    char* p = tmp + 20;
+    while(num >= 100)
+    {
+        unsigned idx = static_cast<unsigned>(num % 100) << 1;
+        num /= 100;
+        *--p = digit_pairs[ idx + 1 ];
+        *--p = digit_pairs[ idx ];
+    }
+    if(num >= 10)
+    {
+        unsigned idx = static_cast<unsigned>(num) << 1;
+        *--p = digit_pairs[ idx + 1 ];
+        *--p = digit_pairs[ idx ];
+    }
+    else
+        *--p = static_cast<char>('0' + num);
+    size_t n = tmp + 20 - p;
+    std::memcpy(buf, p, n);
+    return n;
+}
+
+//! Signed version of format_uint(). The buffer should have at least 21 bytes available.
+inline size_t format_int(char* buf, long long num)
+{
+    if(num >= 0)    return format_uint(buf, static_cast<unsigned long long>(num));
+    *buf = '-';
+    return 1 + format_uint(buf + 1, static_cast<unsigned long long>(0) - static_cast<unsigned long long>(num));
+}
+
+//! Append the decimal representation of `num` to `str`
+inline void append_uint(std::string& str, unsigned long long num)
+{
+    char buf[20];
+    str.append(buf, format_uint(buf, num));
+}
+
+//! Append the decimal representation of `num` to `str`
+inline void append_int(std::string& str, long long num)
+{
+    char buf[21];
+    str.append(buf, format_int(buf, num));
+}
+
+/*! @} */
+}// namespace loon
+
+#endif
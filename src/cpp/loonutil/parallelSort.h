@@ -0,0 +1,106 @@
+#ifndef __LOONUTIL_PARALLEL_SORT_H
+#define __LOONUTIL_PARALLEL_SORT_H
+
+#include <vector>
+#include <future>
+#include <algorithm>
+#include "threadPool.h"
+
+namespace loon
+{
+/*!\ingroup Func_util
+ * @{
+ */
+
+/*! \brief Sort `data` by the tasks of `pool`
+ *
+ * `data` is cut into `pool.size()` parts, which are sorted in parallel. The sorted parts are
+ * then merged pairwise into a buffer as large as `data`, round by round. Each merge is cut into
+ * independent pieces at the positions of the elements of the first part in the second, so that
+ * all the threads are busy in the last rounds as well. With `stable`, equal elements keep their
+ * order, as the parts are sorted by std::stable_sort() and std::merge() is stable.
+ *
+ * Small inputs, or a pool of one thread, are sorted by the calling thread without the buffer.
+ */
+template<class T, class Compare>
+void parallel_sort(std::vector<T>& data, Compare comp, ThreadPool& pool, bool stable = false)
+{
+    size_t n_parts = pool.size();
+    if(n_parts <= 1 || data.size() < (n_parts << 12))
+    {
+        if(stable)
+            std::stable_sort(data.begin(), data.end(), comp);
+        else
+            std::sort(data.begin(), data.end(), comp);
+        return;
+    }
+
+    std::vector<size_t> bounds;     // part i is [bounds[i], bounds[i + 1])
+    for(size_t i = 0; i <= n_parts; ++i)
+        bounds.push_back( data.size() * i / n_parts );
+    std::vector<std::future<void> > done;
+    for(size_t i = 0; i < n_parts; ++i)
+    {
+        T* first = data.data() + bounds[i];
+        T* last = data.data() + bounds[i + 1];
+        done.push_back( pool.submit( [first, last, comp, stable](){
+                    if(stable)
+                        std::stable_sort(first, last, comp);
+                    else
+                        std::sort(first, last, comp);
+                } ) );
+    }
+    for(size_t i = 0; i < done.size(); ++i)
+        done[i].get();
+
+    std::vector<T> buffer( data.size() );
+    T* src = data.data();
+    T* dst = buffer.data();
+    while(bounds.size() > 2)
+    {
+        std::vector<size_t> merged_bounds;
+        size_t n_merges = (bounds.size() - 1) >> 1;
+        size_t n_pieces = std::max<size_t>(n_parts / n_merges, 1);
+        done.clear();
+        for(size_t i = 0; i + 1 < bounds.size(); i += 2)
+        {
+            merged_bounds.push_back( bounds[i] );
+            T* a = src + bounds[i];
+            T* a_end = src + bounds[i + 1];
+            T* out = dst + bounds[i];
+            if(i + 2 == bounds.size())  // the last part has no pair
+            {
+                done.push_back( pool.submit( [a, a_end, out](){ std::copy(a, a_end, out); } ) );
+                continue;
+            }
+            T* b = a_end;
+            T* b_end = src + bounds[i + 2];
+            // `*a_cut` follows the elements of `b` less than it, as std::merge() takes `a` first on ties
+            T* a_prev = a;
+            T* b_prev = b;
+            for(size_t k = 1; k <= n_pieces; ++k)
+            {
+                T* a_cut = k == n_pieces ? a_end : a + (a_end - a) * k / n_pieces;
+                T* b_cut = a_cut == a_end ? b_end : std::lower_bound(b_prev, b_end, *a_cut, comp);
+                T* piece_out = out + (a_prev - a) + (b_prev - b);
+                done.push_back( pool.submit( [a_prev, a_cut, b_prev, b_cut, piece_out, comp](){
+                            std::merge(a_prev, a_cut, b_prev, b_cut, piece_out, comp);
+                        } ) );
+                a_prev = a_cut;
+                b_prev = b_cut;
+            }
+        }
+        merged_bounds.push_back( bounds.back() );
+        for(size_t i = 0; i < done.size(); ++i)
+            done[i].get();
+        bounds.swap( merged_bounds );
+        std::swap(src, dst);
+    }
+    if(src != data.data())
+        data.swap( buffer );
+}
+
+/*! @} */
+}// namespace loon
+
+#endif
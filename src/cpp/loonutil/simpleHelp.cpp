@@ -1,6 +1,8 @@
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
 #include "simpleHelp.h"
+#include "exception.h"
 
 namespace loon
 {
@@ -54,6 +56,25 @@ void SimpleHelp::print_parameter(const std::string& param, int max_width)
     std::cerr << std::endl;
 }
 
+void SimpleHelp::print_options()
+{
+    if(options.empty()) return;
+
+    std::cerr << std::endl << "Optional parameters:" << std::endl;
+    size_t max_width = 0;
+    for(size_t i = 0; i < options.size(); ++i)
+        max_width = std::max(max_width, options[i].name.length() + (options[i].has_value ? 4 : 0));
+    for(size_t i = 0; i < options.size(); ++i)
+    {
+        std::string switch_name = options[i].name + (options[i].has_value ? " <v>" : "");
+        std::cerr << "    " << switch_name << std::string(max_width - switch_name.length() + 2, ' ');
+        std::string description = options[i].description;
+        if(options[i].has_value && !options[i].value.empty())
+            description += " (default: " + options[i].value + ")";
+        print_parameter( description, max_width );
+    }
+}
+
 void SimpleHelp::print_usage(int exit_code)
 {
     print_description();
@@ -62,6 +83,7 @@ void SimpleHelp::print_usage(int exit_code)
     if(n == 0)
     {
         std:: cerr << "No parameters are required!" << std::endl;
+        print_options();
         exit( exit_code );
     }
 
@@ -72,9 +94,61 @@ void SimpleHelp::print_usage(int exit_code)
         print_index(i+1, max_width);
         print_parameter( parameters[i], max_width );
     }
+    print_options();
     exit( exit_code );
 }
 
+SimpleHelp::Option* SimpleHelp::find_option(const std::string& name)
+{
+    for(size_t i = 0; i < options.size(); ++i)
+        if(options[i].name == name)
+            return &options[i];
+    return NULL;
+}
+
+const SimpleHelp::Option* SimpleHelp::find_option(const std::string& name) const
+{
+    for(size_t i = 0; i < options.size(); ++i)
+        if(options[i].name == name)
+            return &options[i];
+    return NULL;
+}
+
+void SimpleHelp::parse_options(int& argc, char* argv[])
+{
+    int n_required = 1;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        std::string value;
+        size_t eq_pos = arg.find('=');
+        if(arg.length() > 1 && arg[0] == '-' && eq_pos != std::string::npos)
+        {
+            value = arg.substr(eq_pos + 1);
+            arg = arg.substr(0, eq_pos);
+        }
+        Option* opt = find_option(arg);
+        if(opt == NULL)
+        {
+            argv[ n_required++ ] = argv[i];
+            continue;
+        }
+        opt->is_set = true;
+        if(!opt->has_value)    continue;
+        if(eq_pos == std::string::npos)
+        {
+            if(i + 1 >= argc)
+            {
+                std::cerr << "ERROR: option " << arg << " requires a value" << std::endl << std::endl;
+                print_usage(1);
+            }
+            value = argv[ ++i ];
+        }
+        opt->value = value;
+    }
+    argc = n_required;
+}
+
 SimpleHelp::SimpleHelp(const std::string& description/* = "" */):
         usage(description)
 {}
@@ -89,7 +163,42 @@ void SimpleHelp::add_argument(const std::string& param)
     parameters.push_back(param);
 }
 
-void SimpleHelp::check(int argc, char* argv[])
+void SimpleHelp::add_option(const std::string& name, const std::string& description, const std::string& default_value)
+{
+    Option opt;
+    opt.name = name;
+    opt.description = description;
+    opt.value = default_value;
+    opt.has_value = true;
+    opt.is_set = false;
+    options.push_back(opt);
+}
+
+void SimpleHelp::add_flag(const std::string& name, const std::string& description)
+{
+    Option opt;
+    opt.name = name;
+    opt.description = description;
+    opt.has_value = false;
+    opt.is_set = false;
+    options.push_back(opt);
+}
+
+const std::string& SimpleHelp::get_option(const std::string& name) const
+{
+    const Option* opt = find_option(name);
+    if(opt == NULL)
+        throw Exception(6, "Unknown option [%s]", name.c_str());
+    return opt->value;
+}
+
+bool SimpleHelp::is_set(const std::string& name) const
+{
+    const Option* opt = find_option(name);
+    return (opt != NULL && opt->is_set);
+}
+
+void SimpleHelp::check(int& argc, char* argv[])
 {
     std::string help_option[] = {std::string("--help"),
             std::string("-help"),
@@ -98,6 +207,7 @@ void SimpleHelp::check(int argc, char* argv[])
         for(int j = 0; j < 3; ++j)
             if(std::string(argv[i]) == help_option[j])
                 print_usage(0);
+    parse_options(argc, argv);
     if(argc != parameters.size() + 1)
     {
         std::cerr << "ERROR: number of parameters doesn't match.\n       The required number of parameters is " << parameters.size() << std::endl << std::endl;
@@ -10,19 +10,43 @@ namespace loon
 class SimpleHelp
 {
 private:
+    class Option
+    {
+    public:
+        std::string name;
+        std::string description;
+        std::string value;
+        bool has_value;
+        bool is_set;
+    };
     std::string usage;
     std::vector<std::string> parameters;
+    std::vector<Option> options;
 
     void print_description();
     int count_digits(size_t num);
     void print_index(size_t idx, int max_width);
     void print_parameter(const std::string& param, int max_width);
+    void print_options();
     void print_usage(int exit_code);
+    Option* find_option(const std::string& name);
+    const Option* find_option(const std::string& name) const;
+    void parse_options(int& argc, char* argv[]);
 public:
     SimpleHelp(const std::string& description = "");
     void set_description(const std::string& description);
     void add_argument(const std::string& param);
-    void check(int argc, char* argv[]);
+
+    // Optional parameters. `name` is the literal switch, e.g. "-t" or "--mem-limit".
+    // An option takes the next command line entry as its value; a flag takes no value.
+    void add_option(const std::string& name, const std::string& description, const std::string& default_value);
+    void add_flag(const std::string& name, const std::string& description);
+    const std::string& get_option(const std::string& name) const;
+    bool is_set(const std::string& name) const;
+
+    // Optional parameters are removed from `argv` (and `argc` is updated), so that
+    // argv[1], argv[2], ... are the required parameters in order after the check.
+    void check(int& argc, char* argv[]);
 };
 
 }//namespace loon
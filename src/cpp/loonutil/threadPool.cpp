@@ -0,0 +1,74 @@
+#include "threadPool.h"
+
+namespace loon
+{
+
+ThreadPool::ThreadPool(size_t n_threads/* = 0 */):
+        n_running(0), stopping(false)
+{
+    if(n_threads == 0)
+        n_threads = std::thread::hardware_concurrency();
+    if(n_threads == 0)
+        n_threads = 1;
+    workers.reserve( n_threads );
+    for(size_t i = 0; i < n_threads; ++i)
+        workers.push_back( std::thread(&ThreadPool::worker_loop, this) );
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    task_cv.notify_all();
+    for(size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+size_t ThreadPool::size() const
+{
+    return workers.size();
+}
+
+std::future<void> ThreadPool::submit(const std::function<void()>& task)
+{
+    std::shared_ptr<std::packaged_task<void()> > packed = std::make_shared<std::packaged_task<void()> >(task);
+    std::future<void> ret = packed->get_future();
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        tasks.push( [packed](){ (*packed)(); } );
+    }
+    task_cv.notify_one();
+    return ret;
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    idle_cv.wait(lock, [this](){ return tasks.empty() && n_running == 0; });
+}
+
+void ThreadPool::worker_loop()
+{
+    while(true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            task_cv.wait(lock, [this](){ return stopping || !tasks.empty(); });
+            if(tasks.empty())   return;
+            task = tasks.front();
+            tasks.pop();
+            ++n_running;
+        }
+        task();
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            --n_running;
+        }
+        idle_cv.notify_all();
+    }
+}
+
+}// namespace loon
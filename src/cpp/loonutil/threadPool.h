@@ -0,0 +1,51 @@
+#ifndef __LOONUTIL_THREAD_POOL_H
+#define __LOONUTIL_THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace loon
+{
+
+/*! \ingroup Class_util
+ * \brief A fixed-size pool of worker threads
+ *
+ * Tasks are executed in the order they are submitted. `submit()` returns a
+ * future, so that the caller can wait for a particular task (e.g., to consume
+ * results in order), while `wait()` blocks until every submitted task is done.
+ * Exceptions thrown by a task are rethrown by the corresponding `future::get()`.
+ */
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()> > tasks;
+    std::mutex mtx;
+    std::condition_variable task_cv;
+    std::condition_variable idle_cv;
+    size_t n_running;
+    bool stopping;
+
+    void worker_loop();
+public:
+    /*! \brief Constructor
+     *
+     * \param [in] n_threads Number of worker threads. If 0, `std::thread::hardware_concurrency()` is used.
+     */
+    explicit ThreadPool(size_t n_threads = 0);
+    ~ThreadPool();
+
+    size_t size() const;//!< Number of worker threads
+    std::future<void> submit(const std::function<void()>& task);
+    void wait();//!< Block until all the submitted tasks have finished
+};
+
+}// namespace loon
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __LOONUTIL_VARINT_H
+#define __LOONUTIL_VARINT_H
+
+#include <string>
+
+namespace loon
+{
+/*!\ingroup Func_util
+ * @{
+ */
+
+//! Map a signed integer to an unsigned one, so that small magnitudes give small numbers: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+inline unsigned long long zigzag_encode(long long num)
+{
+    return (static_cast<unsigned long long>(num) << 1) ^ static_cast<unsigned long long>(num >> 63);
+}
+
+//! Inverse of zigzag_encode()
+inline long long zigzag_decode(unsigned long long num)
+{
+    return static_cast<long long>((num >> 1) ^ (0ULL - (num & 1)));
+}
+
+/*! \brief Append `num` as a LEB128 varint: 7 bits per byte, the lowest bits first,
+ * and the highest bit of each byte set if more bytes follow.
+ */
+inline void append_varint(std::string& str, unsigned long long num)
+{
+    char buf[10];
+    size_t n = 0;
+    while(num >= 0x80)
+    {
+        buf[n++] = static_cast<char>((num & 0x7F) | 0x80);
+        num >>= 7;
+    }
+    buf[n++] = static_cast<char>(num);
+    str.append(buf, n);
+}
+
+/*! \brief Decode a varint written by append_varint()
+ *
+ * \param [in,out] p Moved past the varint
+ * \param [in] end The end of the buffer
+ * \return false if the varint is truncated or longer than 10 bytes
+ */
+inline bool decode_varint(const char*& p, const char* end, unsigned long long& num)
+{
+    unsigned long long ret = 0;
+    for(int shift = 0; shift < 64 && p < end; shift += 7)
+    {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        ret |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+        if((byte & 0x80) == 0)
+        {
+            num = ret;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*! @} */
+}// namespace loon
+
+#endif
@@ -8,6 +8,9 @@
 #include <limits>
 #include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
+#include <loonutil/numFormat.h>
+#include <loonutil/mappedTextReader.h>
+#include <loonutil/manyFileWriter.h>
 
 using namespace std;
 
@@ -29,6 +32,7 @@ vector<Rect> rects;
 vector<size_t> label_left;
 LL component_id = 0;
 ofstream fout_k;
+loon::ManyFileWriter component_files(512, 65536, 67108864);   // the components are small, so they are buffered together
 
 /*========================= class Rect =======================*/
 class Rect: public RectBase
@@ -62,23 +66,27 @@ void write_connected_component(const vector<Rect>::iterator& begin_it, const vec
 {
     if(end_it - begin_it < min_component)  return;
 
-    ofstream fout;
     string directory = outdir + loon::int2path(component_id);
     loon::mkdir_p(directory);
     string path = directory + to_string(component_id) + ".txt";
     fout_k << component_id << ' ' << directory << ' ' << (end_it - begin_it) << endl;
-    loon::open_file(fout, path);
+    size_t file = component_files.add_file(path);
 
+    string line;
     for(vector<Rect>::iterator it = begin_it; it < end_it; ++it)
     {
-        fout << (*it)[0] << ' '
-             << (*it)[1] << ' '
-             << (*it)[2] << ' '
-             << (*it)[3] << ' '
-             << (it->brace) << ' '
-             << (it->dist)<< endl;
+        line.clear();
+        for(size_t i = 0; i < 4; ++i)
+        {
+            loon::append_int(line, (*it)[i]);
+            line.push_back(' ');
+        }
+        line.push_back(it->brace);
+        line.push_back(' ');
+        loon::append_int(line, it->dist);
+        line.push_back('\n');
+        component_files.write(file, line);
     }
-    fout.close();
     ++component_id;
 }
 
@@ -156,19 +164,20 @@ void do_partition()
 
 void read_rectangles()
 {
-    ifstream fin;
-    loon::open_file(fin, infile);
+    loon::MappedTextReader fin(infile);
     Rect tmp;
 
-    string line;
-    while(fin >> tmp[0])
+    while(fin.read_signed(tmp[0]))
     {
-        fin >> tmp[1] >> tmp[2] >> tmp[3] >> tmp.brace >> tmp.dist;
+        fin.read_signed(tmp[1]);
+        fin.read_signed(tmp[2]);
+        fin.read_signed(tmp[3]);
+        fin.read_char(tmp.brace);
+        fin.read_signed(tmp.dist);
         if(tmp[1] - tmp[0] > max_side_length || tmp[3] - tmp[2] > max_side_length)
             continue;
         rects.push_back( tmp );
     }
-    fin.close();
 }
 
 void parse_args(int argc, char* argv[])
@@ -194,6 +203,7 @@ int main(int argc, char* argv[])
     read_rectangles();
     loon::open_file(fout_k, outdir + "spec.txt");
     do_partition();
+    component_files.close_all();
     fout_k.close();
     return 0;
 }
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
+#include <loonutil/mappedTextReader.h>
 
 //#define LOON_DEBUG
 #ifdef LOON_DEBUG
@@ -317,48 +318,45 @@ void find_validated_segments(Type2& type2)
 
 void read_predictions(const string& fname)
 {
-    ifstream fin;
-    loon::open_file(fin, fname);
+    loon::MappedTextReader fin(fname);
     Rect tmp;
-    while(fin >> tmp[0])
+    while(fin.read_unsigned(tmp[0]))
     {
-        fin >> tmp[1] >> tmp[2] >> tmp[3];
+        fin.read_unsigned(tmp[1]);
+        fin.read_unsigned(tmp[2]);
+        fin.read_unsigned(tmp[3]);
         type2_rects.push_back( Type2() );
         type2_rects.back().set_rect( tmp );
 
         find_validated_segments( type2_rects.back() );
     }
-    fin.close();
 }
 
 void read_type2()
 {
     string spec = type2_dir + "spec.txt";
-    ifstream fin;
-    loon::open_file(fin, spec);
+    loon::MappedTextReader fin(spec);
 
     string cp_id, cp_fname;
-    string line;
-    while(fin >> cp_id)
+    const char* line;
+    size_t line_len;
+    while(fin.read_token(cp_id))
     {
-        fin >> cp_fname;
-        getline(fin, line);
+        fin.read_token(cp_fname);
+        fin.read_line(line, line_len);
         read_predictions(loon::get_directory(cp_fname) + loon::directory_delimiter + cp_id + "_sol" + loon::directory_delimiter+ "predictions.sol");
     }
-    fin.close();
 }
 
 void read_validated_segments()
 {
-    ifstream fin;
-    loon::open_file(fin, infile1);
+    loon::MappedTextReader fin(infile1);
     ValidatedSeg tmp;
-    while(fin >> tmp[0])
+    while(fin.read_unsigned(tmp[0]))
     {
-        fin >> tmp[1];
+        fin.read_unsigned(tmp[1]);
         validated_segments.push_back( tmp );
     }
-    fin.close();
     n_vs = validated_segments.size();
     mark_vs.assign(n_vs, 0);
 }
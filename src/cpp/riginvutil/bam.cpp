@@ -0,0 +1,201 @@
+#include <cstring>
+#include <loonutil/exception.h>
+#include "bam.h"
+
+namespace riginv
+{
+
+static const uint32_t BAM_CMATCH = 0;
+static const uint32_t BAM_CINS = 1;
+static const uint32_t BAM_CDEL = 2;
+static const uint32_t BAM_CREF_SKIP = 3;
+static const uint32_t BAM_CSOFT_CLIP = 4;
+static const uint32_t BAM_CHARD_CLIP = 5;
+static const uint32_t BAM_CEQUAL = 7;
+static const uint32_t BAM_CDIFF = 8;
+
+template<class T>
+static T load_le(const char* p)
+{
+    T ret;
+    memcpy(&ret, p, sizeof(T));
+    return ret;
+}
+
+/*======================= class BamRecord =======================*/
+
+BamRecord::BamRecord(const char* data, size_t n)
+{
+    if(n < 32)
+        throw loon::Exception(8, "Truncated BAM record");
+    ref_id = load_le<int32_t>(data);
+    pos = load_le<int32_t>(data + 4);
+    uint8_t l_read_name = static_cast<uint8_t>(data[8]);
+    mapq = static_cast<uint8_t>(data[9]);
+    n_cigar = load_le<uint16_t>(data + 12);
+    flag = load_le<uint16_t>(data + 14);
+    l_seq = load_le<int32_t>(data + 16);
+    qname = data + 32;
+    qname_len = l_read_name > 0 ? l_read_name - 1 : 0;
+    cigar = qname + l_read_name;
+    if(32 + l_read_name + (static_cast<size_t>(n_cigar) << 2) > n)
+        throw loon::Exception(8, "Truncated BAM record");
+}
+
+uint32_t BamRecord::cigar_op(size_t i) const
+{
+    return load_le<uint32_t>(cigar + (i << 2));
+}
+
+bool BamRecord::has_reference_end() const
+{
+    return (flag & FLAG_UNMAPPED) == 0 && n_cigar > 0;
+}
+
+int64_t BamRecord::reference_length() const
+{
+    int64_t ret = 0;
+    for(size_t i = 0; i < n_cigar; ++i)
+    {
+        uint32_t op = cigar_op(i);
+        switch(op & 0xFu)
+        {
+            case BAM_CMATCH: case BAM_CDEL: case BAM_CREF_SKIP: case BAM_CEQUAL: case BAM_CDIFF:
+                ret += op >> 4;
+        }
+    }
+    return ret;
+}
+
+int64_t BamRecord::query_alignment_start() const
+{
+    int64_t ret = 0;
+    for(size_t i = 0; i < n_cigar; ++i)
+    {
+        uint32_t op = cigar_op(i);
+        if((op & 0xFu) == BAM_CSOFT_CLIP)
+            ret += op >> 4;
+        else if((op & 0xFu) != BAM_CHARD_CLIP)
+            break;
+    }
+    return ret;
+}
+
+int64_t BamRecord::query_alignment_end() const
+{
+    int64_t ret = l_seq;
+    if(ret == 0)
+    {// no sequence stored, so the length is computed from the cigar string
+        for(size_t i = 0; i < n_cigar; ++i)
+        {
+            uint32_t op = cigar_op(i) & 0xFu;
+            if(op == BAM_CMATCH || op == BAM_CINS || op == BAM_CEQUAL || op == BAM_CDIFF
+                    || (op == BAM_CSOFT_CLIP && ret == 0))
+                ret += cigar_op(i) >> 4;
+        }
+        return ret;
+    }
+    for(size_t i = n_cigar; i > 1; --i)
+    {
+        uint32_t op = cigar_op(i - 1);
+        if((op & 0xFu) == BAM_CSOFT_CLIP)
+            ret -= op >> 4;
+        else if((op & 0xFu) != BAM_CHARD_CLIP)
+            break;
+    }
+    return ret;
+}
+
+/*======================= class BamReader =======================*/
+
+BamReader::BamReader(const std::string& fname, loon::ThreadPool* pool/* = NULL */):
+        bgzf(fname, pool), buffer_pos(0)
+{
+    read_header();
+}
+
+const BamHeader& BamReader::header() const
+{
+    return hdr;
+}
+
+bool BamReader::ensure(size_t n)
+{
+    std::string batch;
+    while(buffer.size() - buffer_pos < n)
+    {
+        if(!bgzf.read_batch(batch))
+            return false;
+        buffer.erase(0, buffer_pos);
+        buffer_pos = 0;
+        buffer.append(batch);
+    }
+    return true;
+}
+
+void BamReader::read_header()
+{
+    if(!ensure(8) || memcmp(buffer.data(), "BAM\1", 4) != 0)
+        throw loon::Exception(5, "Not a BAM file");
+    size_t l_text = load_le<uint32_t>(buffer.data() + 4);
+    buffer_pos = 8;
+    if(!ensure(l_text + 4))
+        throw loon::Exception(8, "Truncated BAM header");
+    buffer_pos += l_text;
+    size_t n_ref = load_le<uint32_t>(buffer.data() + buffer_pos);
+    buffer_pos += 4;
+    hdr.ref_names.reserve(n_ref);
+    hdr.ref_lengths.reserve(n_ref);
+    for(size_t i = 0; i < n_ref; ++i)
+    {
+        if(!ensure(4))
+            throw loon::Exception(8, "Truncated BAM header");
+        size_t l_name = load_le<uint32_t>(buffer.data() + buffer_pos);
+        buffer_pos += 4;
+        if(!ensure(l_name + 4))
+            throw loon::Exception(8, "Truncated BAM header");
+        hdr.ref_names.push_back( std::string(buffer.data() + buffer_pos, l_name > 0 ? l_name - 1 : 0) );
+        buffer_pos += l_name;
+        hdr.ref_lengths.push_back( load_le<uint32_t>(buffer.data() + buffer_pos) );
+        buffer_pos += 4;
+    }
+}
+
+void BamReader::seek(unsigned long long voffset)
+{
+    bgzf.seek(voffset >> 16);
+    buffer.clear();
+    buffer_pos = 0;
+    size_t uoffset = voffset & 0xFFFFu;
+    if(!ensure(uoffset))
+        throw loon::Exception(6, "Virtual offset %llu is out of range", voffset);
+    buffer_pos = uoffset;
+}
+
+bool BamReader::next_chunk(std::string& chunk)
+{
+    // make sure there is at least one complete record
+    if(!ensure(4))
+    {
+        if(buffer.size() > buffer_pos)
+            throw loon::Exception(8, "Truncated BAM record");
+        return false;
+    }
+    size_t first_size = load_le<uint32_t>(buffer.data() + buffer_pos) + 4;
+    if(!ensure(first_size))
+        throw loon::Exception(8, "Truncated BAM record");
+
+    size_t end = buffer_pos + first_size;
+    while(end + 4 <= buffer.size())
+    {
+        size_t record_size = load_le<uint32_t>(buffer.data() + end) + 4;
+        if(end + record_size > buffer.size())   break;
+        end += record_size;
+    }
+    chunk.assign(buffer, buffer_pos, end - buffer_pos);
+    buffer.erase(0, end);
+    buffer_pos = 0;
+    return true;
+}
+
+}// namespace riginv
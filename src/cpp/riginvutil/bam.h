@@ -0,0 +1,78 @@
+#ifndef __RIGINVUTIL_BAM_H
+#define __RIGINVUTIL_BAM_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "bgzf.h"
+
+namespace riginv
+{
+
+/*! \brief Reference sequences in the BAM header */
+class BamHeader
+{
+public:
+    std::vector<std::string> ref_names;
+    std::vector<unsigned long long> ref_lengths;
+};
+
+/*! \brief A view of one raw BAM record
+ *
+ * The BAM layout is little-endian; the fields are decoded on construction. The
+ * record bytes must outlive the view.
+ */
+class BamRecord
+{
+public:
+    static const uint16_t FLAG_UNMAPPED = 4;
+    static const uint16_t FLAG_REVERSE = 16;
+
+    int32_t ref_id;
+    int32_t pos;
+    uint8_t mapq;
+    uint16_t flag;
+    int32_t l_seq;
+    const char* qname;      // NUL terminated
+    size_t qname_len;       // without the NUL
+    const char* cigar;      // n_cigar little-endian uint32, may be unaligned
+    uint16_t n_cigar;
+public:
+    /*! \param [in] data The record right after its `block_size` field
+     *  \param [in] n The value of `block_size`
+     */
+    BamRecord(const char* data, size_t n);
+
+    uint32_t cigar_op(size_t i) const;
+    bool has_reference_end() const;         //!< pysam returns None for reference_end otherwise
+    int64_t reference_length() const;       //!< pysam `reference_length`
+    int64_t query_alignment_start() const;  //!< pysam `query_alignment_start`
+    int64_t query_alignment_end() const;    //!< pysam `query_alignment_end`
+};
+
+/*! \brief Reader of the header and the raw records of a BAM file
+ *
+ * The records are returned in chunks, each of which contains complete records only
+ * (every record is prefixed by its 4-byte `block_size`), so the chunks can be parsed
+ * independently, e.g., by different threads.
+ */
+class BamReader
+{
+private:
+    BgzfReader bgzf;
+    std::string buffer;
+    size_t buffer_pos;
+    BamHeader hdr;
+
+    bool ensure(size_t n);
+    void read_header();
+public:
+    BamReader(const std::string& fname, loon::ThreadPool* pool = NULL);
+    const BamHeader& header() const;
+    bool next_chunk(std::string& chunk);
+    void seek(unsigned long long voffset);  //!< continue from the record at the virtual offset `voffset` (c.f. BamIndex)
+};
+
+}// namespace riginv
+
+#endif
@@ -0,0 +1,207 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <loonutil/util.h>
+#include "bgzf.h"
+#include "bamIndex.h"
+
+namespace riginv
+{
+
+static const int BAI_MIN_SHIFT = 14;
+static const int BAI_DEPTH = 5;
+
+// Sequential little-endian decoder of an index loaded in memory
+class IndexCursor
+{
+private:
+    const std::string& data;
+    size_t pos;
+public:
+    IndexCursor(const std::string& index_data, size_t start):
+            data(index_data), pos(start)
+    {}
+
+    template<class T>
+    T load()
+    {
+        if(pos + sizeof(T) > data.size())
+            throw loon::Exception(8, "Truncated BAM index");
+        T ret;
+        memcpy(&ret, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return ret;
+    }
+
+    void skip(size_t n)
+    {
+        if(pos + n > data.size())
+            throw loon::Exception(8, "Truncated BAM index");
+        pos += n;
+    }
+};
+
+static unsigned int pseudo_bin(int depth)
+{
+    return ((1u << ((depth + 1) * 3)) - 1) / 7 + 1;
+}
+
+static unsigned int first_leaf_bin(int depth)
+{
+    return ((1u << (depth * 3)) - 1) / 7;
+}
+
+/*======================= class BamIndex::RefIndex =======================*/
+
+BamIndex::RefIndex::RefIndex():
+        has_alignments(false), beg(0), end(0), n_mapped(0), n_unmapped(0)
+{}
+
+/*======================= class BamIndex =======================*/
+
+BamIndex::BamIndex():
+        min_shift(BAI_MIN_SHIFT)
+{}
+
+std::string BamIndex::locate(const std::string& bam_fname)
+{
+    if(loon::file_exist(bam_fname + ".bai"))
+        return bam_fname + ".bai";
+    if(loon::file_exist(bam_fname + ".csi"))
+        return bam_fname + ".csi";
+    if(bam_fname.length() > 4 && bam_fname.compare(bam_fname.length() - 4, 4, ".bam") == 0)
+    {
+        std::string fname = bam_fname.substr(0, bam_fname.length() - 4) + ".bai";
+        if(loon::file_exist(fname))
+            return fname;
+    }
+    return "";
+}
+
+void BamIndex::load(const std::string& fname)
+{
+    std::ifstream fin;
+    loon::open_file(fin, fname, true);
+    std::ostringstream raw;
+    raw << fin.rdbuf();
+    fin.close();
+    std::string data = raw.str();
+    if(data.size() >= 4 && memcmp(data.data(), "BAI\1", 4) == 0)
+    {
+        load_bai(data);
+        return;
+    }
+
+    // CSI is compressed with BGZF
+    data.clear();
+    BgzfReader bgzf(fname);
+    std::string batch;
+    while(bgzf.read_batch(batch))
+        data.append(batch);
+    if(data.size() >= 4 && memcmp(data.data(), "CSI\1", 4) == 0)
+    {
+        load_csi(data);
+        return;
+    }
+    throw loon::Exception(5, "[%s] is neither a BAI nor a CSI index", fname.c_str());
+}
+
+// Keep the range of the alignments, or derive it from the chunks if there is no pseudo-bin
+static void add_chunks(BamIndex::RefIndex& ref, IndexCursor& cursor, unsigned int bin, unsigned int pseudo)
+{
+    int32_t n_chunk = cursor.load<int32_t>();
+    for(int32_t i = 0; i < n_chunk; ++i)
+    {
+        unsigned long long beg = cursor.load<uint64_t>();
+        unsigned long long end = cursor.load<uint64_t>();
+        if(bin == pseudo)
+        {
+            if(i == 0)
+            {
+                ref.beg = beg;
+                ref.end = end;
+            }
+            else if(i == 1)
+            {
+                ref.n_mapped = beg;
+                ref.n_unmapped = end;
+            }
+            ref.has_alignments = true;
+            continue;
+        }
+        if(!ref.has_alignments || beg < ref.beg)   ref.beg = beg;
+        if(!ref.has_alignments || end > ref.end)   ref.end = end;
+        ref.has_alignments = true;
+    }
+}
+
+void BamIndex::load_bai(const std::string& data)
+{
+    IndexCursor cursor(data, 4);
+    min_shift = BAI_MIN_SHIFT;
+    unsigned int pseudo = pseudo_bin(BAI_DEPTH);
+    int32_t n_ref = cursor.load<int32_t>();
+    refs.assign(n_ref, RefIndex());
+    for(int32_t r = 0; r < n_ref; ++r)
+    {
+        int32_t n_bin = cursor.load<int32_t>();
+        for(int32_t b = 0; b < n_bin; ++b)
+        {
+            unsigned int bin = cursor.load<uint32_t>();
+            add_chunks(refs[r], cursor, bin, pseudo);
+        }
+        int32_t n_intv = cursor.load<int32_t>();
+        refs[r].window_offsets.resize(n_intv);
+        for(int32_t i = 0; i < n_intv; ++i)
+            refs[r].window_offsets[i] = cursor.load<uint64_t>();
+    }
+}
+
+void BamIndex::load_csi(const std::string& data)
+{
+    IndexCursor cursor(data, 4);
+    min_shift = cursor.load<int32_t>();
+    int depth = cursor.load<int32_t>();
+    if(min_shift <= 0 || depth < 0 || depth > 9)
+        throw loon::Exception(8, "Unsupported CSI index (min_shift %d, depth %d)", min_shift, depth);
+    int32_t l_aux = cursor.load<int32_t>();
+    cursor.skip(l_aux);
+    unsigned int pseudo = pseudo_bin(depth);
+    unsigned int first_leaf = first_leaf_bin(depth);
+    int32_t n_ref = cursor.load<int32_t>();
+    refs.assign(n_ref, RefIndex());
+    for(int32_t r = 0; r < n_ref; ++r)
+    {
+        int32_t n_bin = cursor.load<int32_t>();
+        for(int32_t b = 0; b < n_bin; ++b)
+        {
+            unsigned int bin = cursor.load<uint32_t>();
+            unsigned long long loffset = cursor.load<uint64_t>();
+            if(bin >= first_leaf && bin < pseudo)
+            {
+                size_t window = bin - first_leaf;
+                if(refs[r].window_offsets.size() <= window)
+                    refs[r].window_offsets.resize(window + 1, 0);
+                refs[r].window_offsets[window] = loffset;
+            }
+            add_chunks(refs[r], cursor, bin, pseudo);
+        }
+    }
+}
+
+unsigned long long BamIndex::offset_of(int32_t ref_id, unsigned long long pos) const
+{
+    if(ref_id < 0 || static_cast<size_t>(ref_id) >= refs.size())
+        throw loon::Exception(6, "Reference %d is not in the BAM index", ref_id);
+    const RefIndex& ref = refs[ref_id];
+    const std::vector<unsigned long long>& offsets = ref.window_offsets;
+    // the offset of an earlier window is also a valid (but looser) answer
+    size_t n_windows = std::min<unsigned long long>((pos >> min_shift) + 1, offsets.size());
+    for(size_t window = n_windows; window > 0; --window)
+        if(offsets[window - 1] != 0)
+            return std::max(offsets[window - 1], ref.beg);
+    return ref.beg;
+}
+
+}// namespace riginv
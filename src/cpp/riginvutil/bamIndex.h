@@ -0,0 +1,60 @@
+#ifndef __RIGINVUTIL_BAM_INDEX_H
+#define __RIGINVUTIL_BAM_INDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace riginv
+{
+
+/*! \brief The parts of a BAI or CSI index that locate the alignments of a reference
+ *
+ * Offsets are BGZF virtual offsets: the compressed offset of a block shifted left by 16,
+ * plus the offset in the uncompressed block (c.f. BamReader::seek).
+ *
+ * For each reference, the pseudo-bin gives the range of all its alignments, and the offsets
+ * of the windows (the linear index of BAI, or the `loffset`s of the smallest bins of CSI)
+ * give where the alignments overlapping each window of `2^min_shift` bases start.
+ */
+class BamIndex
+{
+public:
+    class RefIndex
+    {
+    public:
+        bool has_alignments;
+        unsigned long long beg, end;        // virtual offsets of the alignments of the reference
+        unsigned long long n_mapped, n_unmapped;
+        std::vector<unsigned long long> window_offsets;     // 0 if unknown
+
+        RefIndex();
+    };
+
+    int min_shift;
+    std::vector<RefIndex> refs;
+private:
+    void load_bai(const std::string& data);
+    void load_csi(const std::string& data);
+public:
+    BamIndex();
+
+    /*! \brief Find the index of a BAM file
+     *
+     * Tried in order: `<bam>.bai`, `<bam>.csi`, and `<bam without .bam>.bai`.
+     * \return The file name of the index, or an empty string if there is none.
+     */
+    static std::string locate(const std::string& bam_fname);
+
+    void load(const std::string& fname);    //!< BAI (uncompressed) or CSI (BGZF compressed), by the magic number
+
+    /*! \brief Virtual offset from which all the alignments of `ref_id` at `pos` or after can be read
+     *
+     * The alignments before `pos`, or of other references, may also be read from there.
+     */
+    unsigned long long offset_of(int32_t ref_id, unsigned long long pos) const;
+};
+
+}// namespace riginv
+
+#endif
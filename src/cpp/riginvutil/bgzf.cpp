@@ -0,0 +1,150 @@
+#include <cstring>
+#include <zlib.h>
+#include <loonutil/exception.h>
+#include "bgzf.h"
+
+namespace riginv
+{
+
+static const size_t BGZF_HEADER_SIZE = 18;
+static const size_t BGZF_FOOTER_SIZE = 8;
+
+static unsigned int load_le16(const unsigned char* p)
+{
+    return p[0] | (static_cast<unsigned int>(p[1]) << 8);
+}
+
+static unsigned int load_le32(const unsigned char* p)
+{
+    return p[0] | (static_cast<unsigned int>(p[1]) << 8) | (static_cast<unsigned int>(p[2]) << 16) | (static_cast<unsigned int>(p[3]) << 24);
+}
+
+void BgzfReader::Batch::inflate_blocks()
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(inflateInit2(&zs, -15) != Z_OK)
+        throw loon::Exception(8, "Cannot initialize zlib");
+    size_t n_blocks = block_offsets.size() - 1;
+    for(size_t i = 0; i < n_blocks; ++i)
+    {
+        const unsigned char* block = reinterpret_cast<const unsigned char*>(compressed.data()) + block_offsets[i];
+        size_t block_size = block_offsets[i + 1] - block_offsets[i];
+        size_t isize = data_offsets[i + 1] - data_offsets[i];
+        if(isize == 0)  continue;
+
+        inflateReset(&zs);
+        zs.next_in = const_cast<unsigned char*>(block) + BGZF_HEADER_SIZE;
+        zs.avail_in = block_size - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+        zs.next_out = reinterpret_cast<unsigned char*>(&data[0]) + data_offsets[i];
+        zs.avail_out = isize;
+        int ret = inflate(&zs, Z_FINISH);
+        if(ret != Z_STREAM_END || zs.avail_out != 0)
+        {
+            inflateEnd(&zs);
+            throw loon::Exception(8, "Corrupted BGZF block");
+        }
+    }
+    inflateEnd(&zs);
+    compressed.clear();
+    compressed.shrink_to_fit();
+}
+
+BgzfReader::BgzfReader(const std::string& filename, loon::ThreadPool* thread_pool/* = NULL */, size_t n_blocks_per_batch/* = 64 */):
+        fp(NULL), fname(filename), pool(thread_pool), blocks_per_batch(n_blocks_per_batch),
+        max_inflight(thread_pool == NULL ? 1 : thread_pool->size() + 1), reached_eof(false)
+{
+    fp = fopen(fname.c_str(), "rb");
+    if(fp == NULL)
+        throw loon::Exception(1, "Cannot open file [%s]", fname.c_str());
+}
+
+BgzfReader::~BgzfReader()
+{
+    // tasks still running hold a reference to their batch, but wait for them anyway before closing
+    for(size_t i = 0; i < inflight.size(); ++i)
+        if(inflight[i]->done.valid())
+            inflight[i]->done.wait();
+    if(fp != NULL)  fclose(fp);
+}
+
+void BgzfReader::seek(unsigned long long coffset)
+{
+    for(size_t i = 0; i < inflight.size(); ++i)
+        if(inflight[i]->done.valid())
+            inflight[i]->done.wait();
+    inflight.clear();
+    if(fseeko(fp, static_cast<off_t>(coffset), SEEK_SET) != 0)
+        throw loon::Exception(6, "Cannot seek to %llu in [%s]", coffset, fname.c_str());
+    reached_eof = false;
+}
+
+bool BgzfReader::read_block(Batch& batch)
+{
+    unsigned char header[BGZF_HEADER_SIZE];
+    size_t n_read = fread(header, 1, BGZF_HEADER_SIZE, fp);
+    if(n_read == 0) return false;
+    if(n_read != BGZF_HEADER_SIZE || header[0] != 31 || header[1] != 139 || header[2] != 8 || (header[3] & 4) == 0
+            || load_le16(header + 10) != 6 || header[12] != 'B' || header[13] != 'C')
+        throw loon::Exception(5, "[%s] is not a BGZF file", fname.c_str());
+
+    size_t block_size = load_le16(header + 16) + 1;
+    if(block_size < BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE)
+        throw loon::Exception(8, "Corrupted BGZF block in [%s]", fname.c_str());
+    size_t offset = batch.compressed.size();
+    batch.compressed.resize(offset + block_size);
+    memcpy(&batch.compressed[offset], header, BGZF_HEADER_SIZE);
+    if(fread(&batch.compressed[offset + BGZF_HEADER_SIZE], 1, block_size - BGZF_HEADER_SIZE, fp) != block_size - BGZF_HEADER_SIZE)
+        throw loon::Exception(8, "Truncated BGZF block in [%s]", fname.c_str());
+
+    size_t isize = load_le32(reinterpret_cast<const unsigned char*>(batch.compressed.data()) + offset + block_size - 4);
+    batch.block_offsets.push_back(offset + block_size);
+    batch.data_offsets.push_back(batch.data_offsets.back() + isize);
+    return true;
+}
+
+bool BgzfReader::fill_batch(std::shared_ptr<Batch>& batch)
+{
+    batch = std::make_shared<Batch>();
+    batch->block_offsets.push_back(0);
+    batch->data_offsets.push_back(0);
+    for(size_t i = 0; i < blocks_per_batch; ++i)
+        if(!read_block(*batch))
+        {
+            reached_eof = true;
+            break;
+        }
+    if(batch->block_offsets.size() == 1)
+        return false;
+    batch->data.resize(batch->data_offsets.back());
+    return true;
+}
+
+void BgzfReader::prefetch()
+{
+    while(!reached_eof && inflight.size() < max_inflight)
+    {
+        std::shared_ptr<Batch> batch;
+        if(!fill_batch(batch))  break;
+        if(pool != NULL)
+            batch->done = pool->submit( [batch](){ batch->inflate_blocks(); } );
+        else
+            batch->inflate_blocks();
+        inflight.push_back(batch);
+    }
+}
+
+bool BgzfReader::read_batch(std::string& data)
+{
+    prefetch();
+    if(inflight.empty())    return false;
+    std::shared_ptr<Batch> batch = inflight.front();
+    inflight.pop_front();
+    if(batch->done.valid())
+        batch->done.get();
+    data.swap(batch->data);
+    prefetch();
+    return true;
+}
+
+}// namespace riginv
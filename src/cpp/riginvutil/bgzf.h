@@ -0,0 +1,71 @@
+#ifndef __RIGINVUTIL_BGZF_H
+#define __RIGINVUTIL_BGZF_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <future>
+#include <memory>
+#include <loonutil/threadPool.h>
+
+namespace riginv
+{
+
+/*! \brief Sequential reader of a BGZF file (e.g., BAM) with parallel decompression
+ *
+ * BGZF is a series of independent gzip blocks of at most 64KB uncompressed data.
+ * The compressed blocks are read sequentially, grouped into batches, and each batch
+ * is inflated by one task of the thread pool. Up to `pool->size() + 1` batches are
+ * in flight, so reading from the disk overlaps with decompression. Batches are
+ * always returned in file order.
+ *
+ * If no thread pool is provided, the blocks are inflated in the calling thread.
+ */
+class BgzfReader
+{
+private:
+    class Batch
+    {
+    public:
+        std::string compressed;
+        std::vector<size_t> block_offsets;  // offsets of the blocks in `compressed`
+        std::vector<size_t> data_offsets;   // offsets of the inflated blocks in `data`
+        std::string data;
+        std::future<void> done;
+
+        void inflate_blocks();
+    };
+
+    FILE* fp;
+    std::string fname;
+    loon::ThreadPool* pool;
+    size_t blocks_per_batch;
+    size_t max_inflight;
+    bool reached_eof;
+    std::deque<std::shared_ptr<Batch> > inflight;
+
+    bool read_block(Batch& batch);
+    bool fill_batch(std::shared_ptr<Batch>& batch);
+    void prefetch();
+public:
+    BgzfReader(const std::string& filename, loon::ThreadPool* thread_pool = NULL, size_t n_blocks_per_batch = 64);
+    ~BgzfReader();
+
+    /*! \brief Get the next batch of uncompressed data
+     *
+     * \param [out] data Replaced by the uncompressed bytes of the next batch of blocks.
+     * \return false if there is no more data.
+     */
+    bool read_batch(std::string& data);
+
+    /*! \brief Continue reading from the block at the compressed offset `coffset`
+     *
+     * The batches in flight are dropped.
+     */
+    void seek(unsigned long long coffset);
+};
+
+}// namespace riginv
+
+#endif
@@ -0,0 +1,625 @@
+#include <cstring>
+#include <loonutil/util.h>
+#include <loonutil/numFormat.h>
+#include <loonutil/varint.h>
+#include "briefAlignment.h"
+
+namespace riginv
+{
+
+/*======================= class BriefAln =======================*/
+
+char BriefAln::orientation() const
+{
+    return is_reverse ? 'R' : 'F';
+}
+
+void BriefAln::append_text(std::string& out, const char* qname, size_t qname_len) const
+{
+    char buf[192];
+    char* p = buf;
+    p += loon::format_uint(p, ref_start);   *p++ = ' ';
+    p += loon::format_uint(p, ref_end);     *p++ = ' ';
+    p += loon::format_uint(p, qry_start);   *p++ = ' ';
+    p += loon::format_uint(p, qry_end);     *p++ = ' ';
+    out.append(buf, p - buf);
+    out.append(qname, qname_len);
+    p = buf;
+    *p++ = ' ';
+    p += loon::format_uint(p, ref_end - ref_start); *p++ = ' ';
+    p += loon::format_uint(p, qry_len);     *p++ = ' ';
+    p += loon::format_uint(p, mapq);        *p++ = ' ';
+    *p++ = orientation();
+    *p++ = '\n';
+    out.append(buf, p - buf);
+}
+
+bool BriefAln::operator<(const BriefAln& rhs) const
+{
+    if(ref_start < rhs.ref_start)   return true;
+    if(ref_start > rhs.ref_start)   return false;
+    return ref_end > rhs.ref_end;
+}
+
+/*======================= class BriefAlnBlock =======================*/
+
+template<class T>
+static void append_column(std::string& out, const std::vector<T>& col)
+{
+    out.append(reinterpret_cast<const char*>(col.data()), col.size() * sizeof(T));
+}
+
+template<class T>
+static const char* load_column(const char* p, std::vector<T>& col, size_t n)
+{
+    col.resize(n);
+    memcpy(col.data(), p, n * sizeof(T));
+    return p + n * sizeof(T);
+}
+
+static unsigned int to_uint32(ULL num)
+{
+    if(num > 0xFFFFFFFFull)
+        throw loon::Exception(6, "Query coordinate %llu is out of range of the binary brief alignment format", num);
+    return static_cast<unsigned int>(num);
+}
+
+size_t BriefAlnBlock::encoded_size(size_t n)
+{
+    return n * (8 + 8 + 4 + 4 + 4 + 4 + 1) + ((n + 7) >> 3);
+}
+
+size_t BriefAlnBlock::size() const
+{
+    return ref_start.size();
+}
+
+void BriefAlnBlock::clear()
+{
+    ref_start.clear();
+    ref_end.clear();
+    qry_start.clear();
+    qry_end.clear();
+    qry_len.clear();
+    read_id.clear();
+    mapq.clear();
+    reverse_bits.clear();
+}
+
+void BriefAlnBlock::push_back(const BriefAln& aln)
+{
+    size_t n = size();
+    if((n & 7) == 0)
+        reverse_bits.push_back(0);
+    if(aln.is_reverse)
+        reverse_bits.back() |= static_cast<unsigned char>(1u << (n & 7));
+    ref_start.push_back( aln.ref_start );
+    ref_end.push_back( aln.ref_end );
+    qry_start.push_back( to_uint32(aln.qry_start) );
+    qry_end.push_back( to_uint32(aln.qry_end) );
+    qry_len.push_back( to_uint32(aln.qry_len) );
+    read_id.push_back( aln.read_id );
+    mapq.push_back( static_cast<unsigned char>(aln.mapq > 255 ? 255 : aln.mapq) );
+}
+
+void BriefAlnBlock::get(size_t i, BriefAln& aln) const
+{
+    aln.ref_start = ref_start[i];
+    aln.ref_end = ref_end[i];
+    aln.qry_start = qry_start[i];
+    aln.qry_end = qry_end[i];
+    aln.qry_len = qry_len[i];
+    aln.read_id = read_id[i];
+    aln.mapq = mapq[i];
+    aln.is_reverse = (reverse_bits[i >> 3] >> (i & 7)) & 1;
+}
+
+template<class T>
+static void append_varint_column(std::string& out, const std::vector<T>& col)
+{
+    for(typename std::vector<T>::const_iterator it = col.begin(); it != col.end(); ++it)
+        loon::append_varint(out, *it);
+}
+
+template<class T>
+static const char* load_varint_column(const char* p, const char* end, std::vector<T>& col, size_t n)
+{
+    col.resize(n);
+    unsigned long long num;
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(!loon::decode_varint(p, end, num))
+            throw loon::Exception(8, "Corrupted compressed block in binary brief alignment file");
+        col[i] = static_cast<T>(num);
+    }
+    return p;
+}
+
+void BriefAlnBlock::encode(std::string& out, bool compressed) const
+{
+    unsigned int n = size();
+    out.append(reinterpret_cast<const char*>(&n), 4);
+    if(compressed)
+    {
+        std::string columns;
+        ULL prev = 0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            loon::append_varint(columns, loon::zigzag_encode(static_cast<long long>(ref_start[i] - prev)));
+            prev = ref_start[i];
+        }
+        for(size_t i = 0; i < n; ++i)
+            loon::append_varint(columns, loon::zigzag_encode(static_cast<long long>(ref_end[i] - ref_start[i])));
+        append_varint_column(columns, qry_start);
+        for(size_t i = 0; i < n; ++i)
+            loon::append_varint(columns, loon::zigzag_encode(static_cast<long long>(qry_end[i]) - qry_start[i]));
+        append_varint_column(columns, qry_len);
+        append_varint_column(columns, read_id);
+        append_column(columns, mapq);
+        append_column(columns, reverse_bits);
+        unsigned int n_bytes = columns.size();
+        out.append(reinterpret_cast<const char*>(&n_bytes), 4);
+        out.append(columns);
+        return;
+    }
+    append_column(out, ref_start);
+    append_column(out, ref_end);
+    append_column(out, qry_start);
+    append_column(out, qry_end);
+    append_column(out, qry_len);
+    append_column(out, read_id);
+    append_column(out, mapq);
+    append_column(out, reverse_bits);
+}
+
+void BriefAlnBlock::decode(const char* columns, size_t n)
+{
+    const char* p = columns;
+    p = load_column(p, ref_start, n);
+    p = load_column(p, ref_end, n);
+    p = load_column(p, qry_start, n);
+    p = load_column(p, qry_end, n);
+    p = load_column(p, qry_len, n);
+    p = load_column(p, read_id, n);
+    p = load_column(p, mapq, n);
+    load_column(p, reverse_bits, (n + 7) >> 3);
+}
+
+void BriefAlnBlock::decode_compressed(const char* columns, size_t n, size_t n_bytes)
+{
+    const char* p = columns;
+    const char* end = columns + n_bytes;
+    p = load_varint_column(p, end, ref_start, n);
+    p = load_varint_column(p, end, ref_end, n);
+    p = load_varint_column(p, end, qry_start, n);
+    p = load_varint_column(p, end, qry_end, n);
+    p = load_varint_column(p, end, qry_len, n);
+    p = load_varint_column(p, end, read_id, n);
+    if(end - p != static_cast<std::ptrdiff_t>(n + ((n + 7) >> 3)))
+        throw loon::Exception(8, "Corrupted compressed block in binary brief alignment file");
+    p = load_column(p, mapq, n);
+    load_column(p, reverse_bits, (n + 7) >> 3);
+    ULL prev = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        prev += loon::zigzag_decode(ref_start[i]);
+        ref_start[i] = prev;
+        ref_end[i] = ref_start[i] + loon::zigzag_decode(ref_end[i]);
+        qry_end[i] = static_cast<unsigned int>(qry_start[i] + loon::zigzag_decode(qry_end[i]));
+    }
+}
+
+/*======================= functions =======================*/
+
+bool is_binary_brief_alignment(const std::string& fname)
+{
+    std::ifstream fin;
+    loon::open_file(fin, fname, true);
+    char magic[4] = {0};
+    fin.read(magic, 4);
+    return fin.gcount() == 4 && memcmp(magic, BRIEF_ALN_MAGIC, 4) == 0;
+}
+
+/*======================= class ReadDict =======================*/
+
+ReadDict::ReadDict():
+        name_bytes(0)
+{
+    names.clear();
+}
+
+unsigned int ReadDict::add(const char* qname, size_t qname_len)
+{
+    return add( std::string(qname, qname_len) );
+}
+
+unsigned int ReadDict::add(const std::string& qname)
+{
+    size_t n = names.size();
+    unsigned int read_id = names.add_raw_id( qname );
+    if(names.size() > n)
+        name_bytes += qname.length();
+    return read_id;
+}
+
+const std::string& ReadDict::name(unsigned int read_id) const
+{
+    if(read_id >= names.size())
+        throw loon::Exception(6, "Read ID %u is not in the read dictionary", read_id);
+    return names.get_raw_id( read_id );
+}
+
+size_t ReadDict::size() const
+{
+    return names.size();
+}
+
+// An upper estimate: a name is held by a string of the vector of names, and by up to about 8 bytes
+// of the trie for each character after the prefix it shares with the others
+size_t ReadDict::memory() const
+{
+    return name_bytes * 10 + names.size() * 48;
+}
+
+void ReadDict::save(const std::string& fname) const
+{
+    std::ofstream fout;
+    loon::open_file(fout, fname);
+    std::string buffer;
+    for(size_t i = 0; i < names.size(); ++i)
+    {
+        buffer.append( names.get_raw_id(i) );
+        buffer.push_back('\n');
+        if(buffer.size() >= (1u << 20))
+        {
+            fout.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    }
+    fout.write(buffer.data(), buffer.size());
+    fout.close();
+}
+
+void ReadDict::load(const std::string& fname)
+{
+    std::ifstream fin;
+    loon::open_file(fin, fname);
+    names.clear();
+    name_bytes = 0;
+    std::string line;
+    while(getline(fin, line))
+        add( line );
+    fin.close();
+}
+
+/*======================= class ReadSlots =======================*/
+
+const unsigned int ReadSlots::NONE;
+
+ReadSlots::ReadSlots():
+        n_slots(0)
+{}
+
+void ReadSlots::reserve(size_t n_reads)
+{
+    if(slots.size() < n_reads)
+        slots.resize(n_reads, NONE);
+}
+
+unsigned int ReadSlots::find(unsigned int read_id) const
+{
+    return read_id < slots.size() ? slots[read_id] : NONE;
+}
+
+unsigned int ReadSlots::insert(unsigned int read_id)
+{
+    if(read_id >= slots.size())
+        slots.resize(static_cast<size_t>(read_id) + 1, NONE);
+    if(slots[read_id] == NONE)
+        slots[read_id] = n_slots++;
+    return slots[read_id];
+}
+
+size_t ReadSlots::size() const
+{
+    return n_slots;
+}
+
+/*======================= class BriefAlnEncoder =======================*/
+
+BriefAlnEncoder::BriefAlnEncoder(size_t block_capacity, bool global_ids, bool compressed):
+        block_capacity(block_capacity == 0 ? 1 : block_capacity), global_ids(global_ids),
+        compressed(compressed), n_global_ids(0), n_bytes(0), started(false)
+{}
+
+void BriefAlnEncoder::emit(std::string& out, const std::string& bytes)
+{
+    out.append(bytes);
+    n_bytes += bytes.size();
+}
+
+void BriefAlnEncoder::start(std::string& out)
+{
+    std::string header(BRIEF_ALN_MAGIC, 4);
+    header.push_back( static_cast<char>(BRIEF_ALN_VERSION) );
+    header.push_back( static_cast<char>((global_ids ? BRIEF_ALN_GLOBAL_IDS : BRIEF_ALN_HAS_NAMES)
+            | (compressed ? BRIEF_ALN_COMPRESSED : 0)) );
+    header.append(2, '\0');
+    header.append(reinterpret_cast<const char*>(&BRIEF_ALN_BLOCK_CAPACITY), 4);
+    emit(out, header);
+    started = true;
+}
+
+void BriefAlnEncoder::push_back(const BriefAln& aln, std::string& out)
+{
+    if(!started)    start(out);
+    block.push_back( aln );
+    if(block.size() >= block_capacity)
+    {
+        std::string bytes;
+        block.encode(bytes, compressed);
+        emit(out, bytes);
+        block.clear();
+    }
+}
+
+void BriefAlnEncoder::add(const BriefAln& aln, std::string& out)
+{
+    if(!global_ids)
+        throw loon::Exception(5, "Read names are required to encode brief alignments without global read IDs");
+    if(aln.read_id >= n_global_ids)
+        n_global_ids = aln.read_id + 1;
+    push_back(aln, out);
+}
+
+void BriefAlnEncoder::add(const BriefAln& aln, const char* qname, size_t qname_len, std::string& out)
+{
+    if(global_ids)
+    {
+        add(aln, out);
+        return;
+    }
+    BriefAln tmp = aln;
+    tmp.read_id = names.add(qname, qname_len);
+    push_back(tmp, out);
+}
+
+void BriefAlnEncoder::finish(std::string& out)
+{
+    if(!started)    start(out);
+    std::string bytes;
+    if(block.size() > 0)
+        block.encode(bytes, compressed);
+    block.clear();
+    unsigned int zero = 0;
+    bytes.append(reinterpret_cast<const char*>(&zero), 4);
+
+    unsigned long long names_offset = n_bytes + bytes.size();
+    unsigned int n_reads = global_ids ? n_global_ids : names.size();
+    bytes.append(reinterpret_cast<const char*>(&n_reads), 4);
+    if(!global_ids)
+    {
+        for(unsigned int i = 0; i < n_reads; ++i)
+        {
+            unsigned int len = names.name(i).length();
+            bytes.append(reinterpret_cast<const char*>(&len), 4);
+        }
+        for(unsigned int i = 0; i < n_reads; ++i)
+            bytes.append( names.name(i) );
+    }
+    bytes.append(reinterpret_cast<const char*>(&names_offset), 8);
+    emit(out, bytes);
+}
+
+/*======================= class BriefAlnWriter =======================*/
+
+BriefAlnWriter::BriefAlnWriter():
+        binary(false), is_open(false)
+{}
+
+BriefAlnWriter::BriefAlnWriter(const std::string& fname, bool use_binary, bool global_ids, bool compressed,
+        size_t block_capacity):
+        binary(false), is_open(false)
+{
+    open(fname, use_binary, global_ids, compressed, block_capacity);
+}
+
+BriefAlnWriter::~BriefAlnWriter()
+{
+    if(is_open) close();
+}
+
+void BriefAlnWriter::open(const std::string& fname, bool use_binary, bool global_ids, bool compressed,
+        size_t block_capacity)
+{
+    binary = use_binary;
+    if(binary)
+    {
+        bin_out.open(fname);
+        encoder.reset( new BriefAlnEncoder(block_capacity, global_ids, compressed) );
+    }
+    else
+        loon::open_file(text_out, fname);
+    is_open = true;
+}
+
+void BriefAlnWriter::flush_buffer()
+{
+    if(binary)  bin_out.write_bytes(buffer.data(), buffer.size());
+    else    text_out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void BriefAlnWriter::write(const BriefAln& aln)
+{
+    if(!binary)
+        throw loon::Exception(5, "Read names are required to write brief alignments in the text format");
+    encoder->add(aln, buffer);
+    if(buffer.size() >= (1u << 20))
+        flush_buffer();
+}
+
+void BriefAlnWriter::write(const BriefAln& aln, const char* qname, size_t qname_len)
+{
+    if(binary)  encoder->add(aln, qname, qname_len, buffer);
+    else    aln.append_text(buffer, qname, qname_len);
+    if(buffer.size() >= (1u << 20))
+        flush_buffer();
+}
+
+void BriefAlnWriter::write(const BriefAln& aln, const std::string& qname)
+{
+    write(aln, qname.data(), qname.length());
+}
+
+void BriefAlnWriter::close()
+{
+    if(binary)  encoder->finish(buffer);
+    flush_buffer();
+    if(binary)  bin_out.close();
+    else    text_out.close();
+    is_open = false;
+}
+
+/*======================= class BriefAlnReader =======================*/
+
+BriefAlnReader::BriefAlnReader(const std::string& fname, ReadDict* dict):
+        binary(is_binary_brief_alignment(fname)), global_ids(false), compressed(false), block_pos(0),
+        dict(dict == NULL ? &own_dict : dict), n_file_reads(0)
+{
+    if(!binary)
+    {
+        text_in.open(fname);
+        return;
+    }
+    bin_in.open(fname);
+    char header[12];
+    bin_in.read_bytes(header, 12);
+    if(!bin_in.good() || static_cast<unsigned char>(header[4]) != BRIEF_ALN_VERSION)
+        throw loon::Exception(5, "Unsupported binary brief alignment file [%s]", fname.c_str());
+    global_ids = (static_cast<unsigned char>(header[5]) & BRIEF_ALN_GLOBAL_IDS) != 0;
+    compressed = (static_cast<unsigned char>(header[5]) & BRIEF_ALN_COMPRESSED) != 0;
+    read_names();
+}
+
+void BriefAlnReader::read_names()
+{
+    bin_in.seek(bin_in.file_size() - 8);
+    unsigned long long names_offset = bin_in.read_uint64();
+    bin_in.seek(names_offset);
+    n_file_reads = bin_in.read_uint32();
+    if(!global_ids)
+    {
+        std::vector<unsigned int> lengths;
+        bin_in.read_uint32(lengths, n_file_reads);
+        std::string name;
+        id_map.resize(n_file_reads);
+        for(unsigned int i = 0; i < n_file_reads; ++i)
+        {
+            bin_in.read_string(name, lengths[i]);
+            id_map[i] = dict->add(name);
+        }
+    }
+    if(!bin_in.good())
+        throw loon::Exception(8, "Corrupted read names in binary brief alignment file");
+    bin_in.seek(12);
+}
+
+bool BriefAlnReader::is_binary() const
+{
+    return binary;
+}
+
+bool BriefAlnReader::has_global_ids() const
+{
+    return global_ids;
+}
+
+bool BriefAlnReader::is_compressed() const
+{
+    return compressed;
+}
+
+void BriefAlnReader::load_read_dict(const std::string& fname)
+{
+    own_dict.load(fname);
+}
+
+bool BriefAlnReader::next_block()
+{
+    unsigned int n = bin_in.read_uint32();
+    if(!bin_in.good())
+        throw loon::Exception(8, "Truncated binary brief alignment file");
+    if(n == 0)  return false;
+    if(compressed)
+        block_bytes.resize( bin_in.read_uint32() );
+    else
+        block_bytes.resize( BriefAlnBlock::encoded_size(n) );
+    bin_in.read_bytes(&block_bytes[0], block_bytes.size());
+    if(!bin_in.good())
+        throw loon::Exception(8, "Truncated binary brief alignment file");
+    if(compressed)
+        block.decode_compressed(block_bytes.data(), n, block_bytes.size());
+    else
+        block.decode(block_bytes.data(), n);
+    for(size_t i = 0; i < n; ++i)
+        if(block.read_id[i] >= n_file_reads)
+            throw loon::Exception(8, "Read ID %u is out of range in binary brief alignment file", block.read_id[i]);
+    if(!global_ids)
+        for(size_t i = 0; i < n; ++i)
+            block.read_id[i] = id_map[ block.read_id[i] ];
+    block_pos = 0;
+    return true;
+}
+
+bool BriefAlnReader::next(BriefAln& aln)
+{
+    if(binary)
+    {
+        if(block_pos >= block.size() && !next_block())
+            return false;
+        block.get(block_pos++, aln);
+        return true;
+    }
+    const char* qname;
+    size_t qname_len;
+    char orientation = 'F';
+    if(!text_in.read_unsigned(aln.ref_start))
+        return false;
+    text_in.read_unsigned(aln.ref_end);
+    text_in.read_unsigned(aln.qry_start);
+    text_in.read_unsigned(aln.qry_end);
+    if(!text_in.read_token(qname, qname_len))
+        throw loon::Exception(5, "Truncated brief alignment line");
+    text_in.skip_token();   // ref_len
+    text_in.read_unsigned(aln.qry_len);
+    text_in.read_unsigned(aln.mapq);
+    text_in.read_char(orientation);
+    aln.is_reverse = (orientation == 'R');
+    aln.read_id = dict->add(qname, qname_len);
+    return true;
+}
+
+void BriefAlnReader::release()
+{
+    if(!binary)
+        text_in.release();
+}
+
+const std::string& BriefAlnReader::read_name(unsigned int read_id) const
+{
+    if(global_ids)  return own_dict.name(read_id);
+    return dict->name(read_id);
+}
+
+size_t BriefAlnReader::read_names_memory() const
+{
+    return global_ids ? own_dict.memory() : dict->memory();
+}
+
+size_t BriefAlnReader::n_reads() const
+{
+    return global_ids ? n_file_reads : dict->size();
+}
+
+}// namespace riginv
@@ -0,0 +1,239 @@
+#ifndef __RIGINVUTIL_BRIEF_ALIGNMENT_H
+#define __RIGINVUTIL_BRIEF_ALIGNMENT_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <loonutil/iobin.h>
+#include <loonutil/relabel.h>
+#include <loonutil/mappedTextReader.h>
+
+namespace riginv
+{
+
+typedef unsigned long long ULL;
+
+/*! \brief One line of the brief alignment format
+ *
+ * The text format has 9 space separated columns:
+ * `ref_start ref_end qry_start qry_end qname ref_len qry_len mapq orientation`,
+ * where `ref_len` is always `ref_end - ref_start` and `orientation` is `F` or `R`.
+ *
+ * `read_id` is the interned `qname`. It is only meaningful together with the reader
+ * or the writer that assigned it, or with the read dictionary of the run (c.f. ReadDict).
+ */
+class BriefAln
+{
+public:
+    ULL ref_start, ref_end;
+    ULL qry_start, qry_end;
+    ULL qry_len;
+    unsigned int read_id;
+    unsigned int mapq;
+    bool is_reverse;
+public:
+    char orientation() const;
+    void append_text(std::string& out, const char* qname, size_t qname_len) const;
+    bool operator<(const BriefAln& rhs) const;  //!< ref_start ascending, then ref_end descending
+};
+
+/*! \brief Column-oriented block of brief alignments
+ *
+ * The binary brief alignment file is
+ *
+ *  * header: magic `RBAL`, version (uint8), flags (uint8), reserved (uint16), block capacity (uint32)
+ *  * blocks, each of which is the number of records `n` (uint32) followed by the columns
+ *    `ref_start` (uint64 * n), `ref_end` (uint64 * n), `qry_start`, `qry_end`, `qry_len`,
+ *    `read_id` (uint32 * n each), `mapq` (uint8 * n) and the orientation bits (uint8 * ceil(n/8), 1 for `R`)
+ *  * a block with `n = 0` as the terminator
+ *  * the number of reads `m` (uint32), i.e. all the `read_id`s are smaller than `m`, followed by
+ *    the read names if `flags & HAS_NAMES`: their lengths (uint32 * m) and the concatenated names.
+ *    The `read_id` column indexes these names.
+ *  * footer: offset of the number of reads (uint64)
+ *
+ * If `flags & GLOBAL_IDS`, the file has no read names, and `read_id` indexes the read dictionary
+ * of the run that produced the file (c.f. ReadDict).
+ *
+ * If `flags & COMPRESSED`, each block is `n` (uint32), the number of bytes `m` (uint32) of the
+ * columns, and the columns as varints (c.f. loon::append_varint): the difference of `ref_start`
+ * from the previous record of the block (zigzag encoded, the first from 0), `ref_end - ref_start`
+ * (zigzag), `qry_start`, `qry_end - qry_start` (zigzag), `qry_len` and `read_id`, followed by
+ * `mapq` and the orientation bits as above. A block doesn't depend on the other blocks, so
+ * the blocks can be decoded in any order. The terminator is still `n = 0` without `m`.
+ *
+ * All the integers are in the byte order of the machine, as in loon::BinWriter.
+ */
+class BriefAlnBlock
+{
+public:
+    std::vector<ULL> ref_start, ref_end;
+    std::vector<unsigned int> qry_start, qry_end, qry_len, read_id;
+    std::vector<unsigned char> mapq;
+    std::vector<unsigned char> reverse_bits;
+public:
+    static size_t encoded_size(size_t n);//!< number of bytes of the columns of `n` records
+
+    size_t size() const;
+    void clear();
+    void push_back(const BriefAln& aln);
+    void get(size_t i, BriefAln& aln) const;
+    void encode(std::string& out, bool compressed = false) const;   //!< append `n` (and `m`) and the columns
+    void decode(const char* columns, size_t n);         //!< `columns` points right after `n`
+    void decode_compressed(const char* columns, size_t n, size_t n_bytes);  //!< `columns` points right after `m`
+};
+
+const char BRIEF_ALN_MAGIC[] = "RBAL";
+const unsigned char BRIEF_ALN_VERSION = 1;
+const unsigned char BRIEF_ALN_HAS_NAMES = 1;
+const unsigned char BRIEF_ALN_GLOBAL_IDS = 2;
+const unsigned char BRIEF_ALN_COMPRESSED = 4;
+const unsigned int BRIEF_ALN_BLOCK_CAPACITY = 65536;
+
+//! true if `fname` is a binary brief alignment file (by its magic number)
+bool is_binary_brief_alignment(const std::string& fname);
+
+/*! \brief Read dictionary of a run
+ *
+ * Dense read IDs assigned by the extractor, in the order the reads first appear. It is
+ * saved as a text file, in which the `i`-th line (0-based) is the name of the read with ID `i`.
+ */
+class ReadDict
+{
+private:
+    loon::RelabelString<int> names;
+    size_t name_bytes;      // total length of the names
+public:
+    ReadDict();
+    unsigned int add(const char* qname, size_t qname_len);
+    unsigned int add(const std::string& qname);
+    const std::string& name(unsigned int read_id) const;
+    size_t size() const;
+    size_t memory() const;  //!< approximate number of bytes taken by the names
+    void save(const std::string& fname) const;
+    void load(const std::string& fname);
+};
+
+/*! \brief Dense slots of the reads in the order they first appear, indexed by the read IDs
+ *
+ * Tools keep their per-read data in flat vectors indexed by the slots. The order of the
+ * slots only depends on the order of the alignments, not on how the read IDs were assigned.
+ */
+class ReadSlots
+{
+private:
+    std::vector<unsigned int> slots;
+    unsigned int n_slots;
+public:
+    static const unsigned int NONE = 0xFFFFFFFFu;
+
+    ReadSlots();
+    void reserve(size_t n_reads);
+    unsigned int find(unsigned int read_id) const;      //!< NONE if `read_id` does not have a slot
+    unsigned int insert(unsigned int read_id);          //!< slot of `read_id`. A new slot is `size() - 1`
+    size_t size() const;
+};
+
+/*! \brief Incrementally encode brief alignments into the binary format
+ *
+ * The encoded bytes are appended to a caller-provided string, so the caller decides
+ * how and when they reach the disk. Read names are interned by a loon::RelabelString,
+ * unless `global_ids` is set, in which case the `read_id`s of the run are stored as they are.
+ * At most `block_capacity` records are held in memory before a block is emitted.
+ * With `compressed`, the blocks are varint encoded (c.f. BRIEF_ALN_COMPRESSED).
+ */
+class BriefAlnEncoder
+{
+private:
+    BriefAlnBlock block;
+    ReadDict names;
+    size_t block_capacity;
+    bool global_ids;
+    bool compressed;
+    unsigned int n_global_ids;      // max `read_id` + 1 for `global_ids`
+    unsigned long long n_bytes;     // bytes produced so far
+    bool started;
+
+    void emit(std::string& out, const std::string& bytes);
+    void start(std::string& out);
+    void push_back(const BriefAln& aln, std::string& out);
+public:
+    BriefAlnEncoder(size_t block_capacity = BRIEF_ALN_BLOCK_CAPACITY, bool global_ids = false, bool compressed = false);
+    void add(const BriefAln& aln, std::string& out);    //!< only for `global_ids`
+    void add(const BriefAln& aln, const char* qname, size_t qname_len, std::string& out);
+    void finish(std::string& out);
+};
+
+/*! \brief Writer of brief alignments in either the text or the binary format
+ *
+ * With `global_ids` (binary format only), the `read_id`s of the run are written instead of the names.
+ * With `compressed` (binary format only), the blocks are varint encoded.
+ * The binary blocks hold at most `block_capacity` records, which is what a reader of the file holds.
+ */
+class BriefAlnWriter
+{
+private:
+    bool binary;
+    std::ofstream text_out;
+    loon::BinWriter bin_out;
+    std::unique_ptr<BriefAlnEncoder> encoder;
+    std::string buffer;
+    bool is_open;
+
+    void flush_buffer();
+public:
+    BriefAlnWriter();
+    BriefAlnWriter(const std::string& fname, bool use_binary, bool global_ids = false, bool compressed = false,
+            size_t block_capacity = BRIEF_ALN_BLOCK_CAPACITY);
+    ~BriefAlnWriter();
+    void open(const std::string& fname, bool use_binary, bool global_ids = false, bool compressed = false,
+            size_t block_capacity = BRIEF_ALN_BLOCK_CAPACITY);
+    void write(const BriefAln& aln);    //!< only for `global_ids`
+    void write(const BriefAln& aln, const char* qname, size_t qname_len);
+    void write(const BriefAln& aln, const std::string& qname);
+    void close();
+};
+
+/*! \brief Reader of brief alignments in either the text or the binary format
+ *
+ * The format is detected by the magic number of the file. Read names are interned into
+ * `dict` in the order they appear, so that the readers sharing one dictionary agree on the
+ * read IDs. Without `dict`, the reader has its own dictionary.
+ *
+ * Files with global IDs (c.f. BRIEF_ALN_GLOBAL_IDS) keep the read IDs of their run, and `dict`
+ * is not used for them. Their read names are only known after load_read_dict().
+ */
+class BriefAlnReader
+{
+private:
+    bool binary;
+    bool global_ids;
+    bool compressed;
+    loon::MappedTextReader text_in;
+    loon::BinReader bin_in;
+    BriefAlnBlock block;
+    size_t block_pos;
+    std::string block_bytes;
+    ReadDict own_dict;
+    ReadDict* dict;
+    std::vector<unsigned int> id_map;   // file IDs -> `dict` IDs for the binary files with names
+    unsigned int n_file_reads;          // number of reads in the binary file
+
+    bool next_block();
+    void read_names();
+public:
+    BriefAlnReader(const std::string& fname, ReadDict* dict = NULL);
+    bool is_binary() const;
+    bool has_global_ids() const;
+    bool is_compressed() const;
+    void load_read_dict(const std::string& fname);  //!< the read dictionary of the run, for the files with global IDs
+    bool next(BriefAln& aln);
+    void release();     //!< release the pages of a text file read so far (c.f. loon::MappedTextReader::release())
+    const std::string& read_name(unsigned int read_id) const;
+    size_t read_names_memory() const;   //!< approximate number of bytes taken by the read names held
+    size_t n_reads() const;     //!< all the read IDs seen so far are smaller than this (all of them for binary files)
+};
+
+}// namespace riginv
+
+#endif
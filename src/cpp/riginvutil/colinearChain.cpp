@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <loonutil/util.h>
+#include "colinearChain.h"
+
+namespace riginv
+{
+
+/*======================= class ChainAnchor =======================*/
+
+ChainAnchor::ChainAnchor(ULL ref_start, ULL ref_end, ULL qry_start, ULL qry_end):
+        ref_start(ref_start), ref_end(ref_end), qry_start(qry_start), qry_end(qry_end)
+{}
+
+ULL ChainAnchor::length() const
+{
+    return (ref_end - ref_start) + (qry_end - qry_start);
+}
+
+ULL ChainAnchor::extension(const ChainAnchor& pred) const
+{
+    ULL ref_from = std::max(ref_start, pred.ref_end), qry_from = std::max(qry_start, pred.qry_end);
+    return (ref_end > ref_from ? ref_end - ref_from : 0) + (qry_end > qry_from ? qry_end - qry_from : 0);
+}
+
+/*======================= class ColinearChainer =======================*/
+
+ColinearChainer::ColinearChainer(ULL max_overlap):
+        max_overlap(max_overlap), best_anchor(NO_PREDECESSOR)
+{}
+
+void ColinearChainer::clear()
+{
+    anchors.clear();
+    scores.clear();
+    predecessors.clear();
+    first_ref_starts.clear();
+    max_ref_ends.clear();
+    staircase.clear();
+    while(!pending.empty())
+        pending.pop();
+    overlapped.clear();
+    best_anchor = NO_PREDECESSOR;
+}
+
+// Put the anchor on the staircase, unless an anchor ending no later on the query has a score at least
+// as high, and remove the anchors it beats
+void ColinearChainer::climb(size_t anchor)
+{
+    ULL key = anchors[anchor].qry_end;
+    std::map<ULL, size_t>::iterator it = staircase.upper_bound(key);
+    if(it != staircase.begin() && scores[ std::prev(it)->second ] >= scores[anchor])
+        return;
+    for(it = staircase.lower_bound(key); it != staircase.end() && scores[it->second] <= scores[anchor]; )
+        it = staircase.erase(it);
+    staircase[key] = anchor;
+}
+
+// Take `pred` for `anchor` if the chain is better than `best_score`
+void ColinearChainer::extend(size_t pred, const ChainAnchor& anchor, size_t& best_pred, ULL& best_score) const
+{
+    ULL score = scores[pred] + anchor.extension( anchors[pred] );
+    if(score > best_score)
+    {
+        best_pred = pred;
+        best_score = score;
+    }
+}
+
+size_t ColinearChainer::add(const ChainAnchor& anchor)
+{
+    if(!anchors.empty() && anchor.ref_start < anchors.back().ref_start)
+        throw loon::Exception(6, "Anchor at %llu is added after the one at %llu", anchor.ref_start, anchors.back().ref_start);
+    // the anchors ending at most `max_overlap` after its start on the reference can be extended
+    // by it, and those ending before its start go to the staircase
+    for(; !pending.empty() && pending.top().first <= anchor.ref_start + max_overlap; pending.pop())
+        overlapped.insert( pending.top() );
+    for(; !overlapped.empty() && overlapped.begin()->first <= anchor.ref_start; overlapped.erase(overlapped.begin()))
+        climb( overlapped.begin()->second );
+
+    // the best of the staircase ending before it on the query, then those overlapping it
+    size_t id = anchors.size();
+    size_t pred = NO_PREDECESSOR;
+    ULL score = anchor.length();
+    ULL max_qry_end = anchor.qry_start + max_overlap;
+    std::map<ULL, size_t>::const_iterator it = staircase.upper_bound(anchor.qry_start);
+    if(it != staircase.begin())
+        extend(std::prev(it)->second, anchor, pred, score);
+    for(; it != staircase.end() && it->first <= max_qry_end; ++it)
+        extend(it->second, anchor, pred, score);
+    for(std::set<std::pair<ULL, size_t> >::const_iterator ov = overlapped.begin(); ov != overlapped.end(); ++ov)
+    {
+        if(anchors[ov->second].qry_end <= max_qry_end)
+            extend(ov->second, anchor, pred, score);
+    }
+
+    anchors.push_back( anchor );
+    predecessors.push_back( pred );
+    scores.push_back( score );
+    if(pred == NO_PREDECESSOR)
+    {
+        first_ref_starts.push_back( anchor.ref_start );
+        max_ref_ends.push_back( anchor.ref_end );
+    }
+    else
+    {
+        first_ref_starts.push_back( first_ref_starts[pred] );
+        max_ref_ends.push_back( std::max(max_ref_ends[pred], anchor.ref_end) );
+    }
+    pending.push( std::make_pair(anchor.ref_end, id) );
+    if(best_anchor == NO_PREDECESSOR || scores[id] > scores[best_anchor])
+        best_anchor = id;
+    return id;
+}
+
+size_t ColinearChainer::size() const
+{
+    return anchors.size();
+}
+
+bool ColinearChainer::empty() const
+{
+    return anchors.empty();
+}
+
+const ChainAnchor& ColinearChainer::anchor(size_t i) const
+{
+    return anchors[i];
+}
+
+size_t ColinearChainer::best() const
+{
+    return best_anchor;
+}
+
+ULL ColinearChainer::score(size_t i) const
+{
+    return scores[i];
+}
+
+size_t ColinearChainer::predecessor(size_t i) const
+{
+    return predecessors[i];
+}
+
+void ColinearChainer::ref_span(size_t i, ULL& ref_start, ULL& ref_end) const
+{
+    ref_start = first_ref_starts[i];
+    ref_end = max_ref_ends[i];
+}
+
+void ColinearChainer::chain(size_t i, std::vector<size_t>& ids) const
+{
+    ids.clear();
+    for(; i != NO_PREDECESSOR; i = predecessors[i])
+        ids.push_back(i);
+    std::reverse(ids.begin(), ids.end());
+}
+
+}// namespace riginv
@@ -0,0 +1,83 @@
+#ifndef __RIGINVUTIL_COLINEAR_CHAIN_H
+#define __RIGINVUTIL_COLINEAR_CHAIN_H
+
+#include <cstddef>
+#include <map>
+#include <queue>
+#include <set>
+#include <vector>
+#include <functional>
+
+namespace riginv
+{
+
+typedef unsigned long long ULL;
+
+//! An interval of the reference matched to an interval of the query
+class ChainAnchor
+{
+public:
+    ULL ref_start, ref_end;
+    ULL qry_start, qry_end;
+public:
+    ChainAnchor(ULL ref_start = 0, ULL ref_end = 0, ULL qry_start = 0, ULL qry_end = 0);
+    ULL length() const;     //!< on the reference and on the query
+    //! The length of this anchor on the reference and on the query beyond the end of `pred`
+    ULL extension(const ChainAnchor& pred) const;
+};
+
+/*! \brief Colinear chaining of anchors
+ *
+ * A chain is a sequence of anchors ascending on both the reference and the query: an anchor starts
+ * at most `max_overlap` before the end of the one before it on both. The score of a chain is its
+ * coverage of the reference and the query: the length of its first anchor, plus what each anchor
+ * extends the one before it by on the reference and on the query (c.f. extension()), so the
+ * overlaps are only counted once.
+ *
+ * The anchors are added in ascending `ref_start`, and the best chain ending at each anchor is found
+ * when it is added, by patience sorting: the anchors which are ended on the reference are kept as a
+ * staircase of ascending `qry_end` and ascending score, in which the anchor to extend is found by
+ * binary search. Only the anchors ending within `max_overlap` of the start of the new one, on the
+ * reference or on the query, are compared one by one. So k anchors take O(k log k) unless many of
+ * them end that close, and the chains are recovered by predecessor links.
+ */
+class ColinearChainer
+{
+public:
+    static const size_t NO_PREDECESSOR = size_t(-1);
+private:
+    ULL max_overlap;
+    std::vector<ChainAnchor> anchors;
+    std::vector<ULL> scores;            // of the best chain ending at each anchor
+    std::vector<size_t> predecessors;
+    std::vector<ULL> first_ref_starts;  // `ref_start` of the first anchor of the chain
+    std::vector<ULL> max_ref_ends;      // the maximum `ref_end` of the anchors of the chain
+    std::map<ULL, size_t> staircase;    // qry_end -> anchor
+    std::priority_queue<std::pair<ULL, size_t>, std::vector<std::pair<ULL, size_t> >,
+            std::greater<std::pair<ULL, size_t> > > pending;   // (ref_end, anchor) not yet extendable
+    std::set<std::pair<ULL, size_t> > overlapped;   // (ref_end, anchor) extendable, but not ended on the reference
+    size_t best_anchor;
+
+    void climb(size_t anchor);
+    void extend(size_t pred, const ChainAnchor& anchor, size_t& best_pred, ULL& best_score) const;
+public:
+    explicit ColinearChainer(ULL max_overlap = 0);
+    void clear();
+    //! Add an anchor, in ascending `ref_start`, and return its index
+    size_t add(const ChainAnchor& anchor);
+
+    size_t size() const;
+    bool empty() const;
+    const ChainAnchor& anchor(size_t i) const;
+    size_t best() const;                    //!< the anchor ending the best chain of all
+    ULL score(size_t i) const;              //!< of the best chain ending at anchor `i`
+    size_t predecessor(size_t i) const;     //!< in that chain, or NO_PREDECESSOR
+    //! The reference span of the best chain ending at anchor `i`, without backtracking
+    void ref_span(size_t i, ULL& ref_start, ULL& ref_end) const;
+    //! The anchors of the best chain ending at anchor `i`, in order
+    void chain(size_t i, std::vector<size_t>& ids) const;
+};
+
+}// namespace riginv
+
+#endif
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <loonutil/util.h>
+#include <loonutil/iobin.h>
+#include "coveragePyramid.h"
+
+namespace riginv
+{
+
+CoveragePyramid::CoveragePyramid():
+        min_cutoff(0), min_aln_len(0), min_mapping_quality(0), total_covered_length(0),
+        ref_len(0), run_start(0), run_coverage(0)
+{}
+
+void CoveragePyramid::reset(ULL ref_len, const std::vector<ULL>& bin_widths)
+{
+    this->ref_len = ref_len;
+    widths = bin_widths;
+    mins.resize( widths.size() );
+    maxs.resize( widths.size() );
+    sums.resize( widths.size() );
+    for(size_t level = 0; level < widths.size(); ++level)
+    {
+        if(widths[level] == 0 || (level > 0 && widths[level] % widths[level - 1] != 0))
+            throw loon::Exception(6, "Bin width %llu is not a multiple of the one of the level before", widths[level]);
+        size_t n = (ref_len + widths[level] - 1) / widths[level];
+        mins[level].assign(n, UINT_MAX);
+        maxs[level].assign(n, 0);
+        sums[level].assign(n, 0);
+    }
+    run_start = 0;
+    run_coverage = 0;
+}
+
+void CoveragePyramid::add(ULL start, unsigned int cvg)
+{
+    ULL w = widths[0];
+    for(ULL pos = run_start, end = std::min(start, ref_len); pos < end; )
+    {
+        size_t bin = pos / w;
+        ULL bin_end = std::min((bin + 1) * w, end);
+        mins[0][bin] = std::min(mins[0][bin], run_coverage);
+        maxs[0][bin] = std::max(maxs[0][bin], run_coverage);
+        sums[0][bin] += run_coverage * (bin_end - pos);
+        pos = bin_end;
+    }
+    run_start = start;
+    run_coverage = cvg;
+}
+
+void CoveragePyramid::finish()
+{
+    add(ref_len, 0);
+    for(size_t level = 1; level < widths.size(); ++level)
+    {
+        size_t r = widths[level] / widths[level - 1];
+        for(size_t bin = 0; bin < mins[level - 1].size(); ++bin)
+        {
+            size_t up = bin / r;
+            mins[level][up] = std::min(mins[level][up], mins[level - 1][bin]);
+            maxs[level][up] = std::max(maxs[level][up], maxs[level - 1][bin]);
+            sums[level][up] += sums[level - 1][bin];
+        }
+    }
+}
+
+void CoveragePyramid::save(const std::string& fname) const
+{
+    loon::BinWriter bin_out(fname);
+    bin_out.write_bytes(COVERAGE_PYRAMID_MAGIC, 4);
+    bin_out.write_uint8(COVERAGE_PYRAMID_VERSION);
+    const char reserved[3] = {0};
+    bin_out.write_bytes(reserved, 3);
+    bin_out.write_uint64(ref_len);
+    bin_out.write_uint64(min_cutoff);
+    bin_out.write_uint64(min_aln_len);
+    bin_out.write_uint64(min_mapping_quality);
+    bin_out.write_double(total_covered_length);
+    bin_out.write_uint32( static_cast<unsigned int>(widths.size()) );
+    for(size_t level = 0; level < widths.size(); ++level)
+    {
+        bin_out.write_uint64(widths[level]);
+        bin_out.write_uint64(mins[level].size());
+        bin_out.write_uint32(mins[level]);
+        bin_out.write_uint32(maxs[level]);
+        bin_out.write_uint64(sums[level]);
+    }
+    bin_out.close();
+}
+
+void CoveragePyramid::load(const std::string& fname)
+{
+    loon::BinReader bin_in(fname);
+    char header[8];
+    bin_in.read_bytes(header, 8);
+    if(!bin_in.good() || memcmp(header, COVERAGE_PYRAMID_MAGIC, 4) != 0
+            || static_cast<unsigned char>(header[4]) != COVERAGE_PYRAMID_VERSION)
+        throw loon::Exception(5, "Unsupported coverage pyramid file [%s]", fname.c_str());
+    ref_len = bin_in.read_uint64();
+    min_cutoff = bin_in.read_uint64();
+    min_aln_len = bin_in.read_uint64();
+    min_mapping_quality = bin_in.read_uint64();
+    total_covered_length = bin_in.read_double();
+    size_t k = bin_in.read_uint32();
+    widths.resize(k);
+    mins.resize(k);
+    maxs.resize(k);
+    sums.resize(k);
+    bool is_valid = (k > 0);
+    for(size_t level = 0; level < k && is_valid && bin_in.good(); ++level)
+    {
+        widths[level] = bin_in.read_uint64();
+        size_t n = bin_in.read_uint64();
+        is_valid = widths[level] > 0 && n == (ref_len + widths[level] - 1) / widths[level]
+                && (level == 0 || widths[level] % widths[level - 1] == 0);
+        if(!is_valid)   break;
+        bin_in.read_uint32(mins[level], n);
+        bin_in.read_uint32(maxs[level], n);
+        bin_in.read_uint64(sums[level], n);
+    }
+    if(!bin_in.good() || !is_valid)
+        throw loon::Exception(8, "Corrupted coverage pyramid file [%s]", fname.c_str());
+}
+
+ULL CoveragePyramid::reference_length() const
+{
+    return ref_len;
+}
+
+size_t CoveragePyramid::n_levels() const
+{
+    return widths.size();
+}
+
+ULL CoveragePyramid::bin_width(size_t level) const
+{
+    return widths[level];
+}
+
+size_t CoveragePyramid::n_bins(size_t level) const
+{
+    return mins[level].size();
+}
+
+unsigned int CoveragePyramid::bin_min(size_t level, size_t bin) const
+{
+    return mins[level][bin];
+}
+
+unsigned int CoveragePyramid::bin_max(size_t level, size_t bin) const
+{
+    return maxs[level][bin];
+}
+
+double CoveragePyramid::bin_mean(size_t level, size_t bin) const
+{
+    ULL start = bin * widths[level];
+    return double(sums[level][bin]) / (std::min(start + widths[level], ref_len) - start);
+}
+
+// The maximum of the bins [first, last) of `level`, from the coarsest bins inside them
+unsigned int CoveragePyramid::range_max(size_t level, size_t first, size_t last) const
+{
+    unsigned int m = 0;
+    for(; first < last; ++level)
+    {
+        if(level + 1 < widths.size())
+        {
+            size_t r = widths[level + 1] / widths[level];
+            size_t up_first = (first + r - 1) / r;
+            size_t up_last = (last == maxs[level].size()) ? maxs[level + 1].size() : last / r;
+            if(up_first < up_last)
+            {
+                for(size_t bin = first; bin < up_first * r; ++bin)
+                    m = std::max(m, maxs[level][bin]);
+                for(size_t bin = up_last * r; bin < last; ++bin)
+                    m = std::max(m, maxs[level][bin]);
+                first = up_first;
+                last = up_last;
+                continue;
+            }
+        }
+        for(size_t bin = first; bin < last; ++bin)
+            m = std::max(m, maxs[level][bin]);
+        break;
+    }
+    return m;
+}
+
+void CoveragePyramid::max_bounds(ULL first, ULL last, unsigned int& lower, unsigned int& upper,
+        ULL& inner_first, ULL& inner_last) const
+{
+    lower = 0;
+    inner_first = inner_last = last;
+    if(first >= last)
+    {
+        upper = 0;
+        return;
+    }
+    if(last > ref_len)
+    { // nothing is known beyond the reference
+        upper = UINT_MAX;
+        return;
+    }
+    ULL w = widths[0];
+    size_t first_bin = (first + w - 1) / w;
+    size_t last_bin = (last == ref_len) ? mins[0].size() : last / w;
+    if(first_bin < last_bin)
+    {
+        lower = range_max(0, first_bin, last_bin);
+        inner_first = first_bin * w;
+        inner_last = std::min(last_bin * w, ref_len);
+    }
+    upper = range_max(0, first / w, (last - 1) / w + 1);
+}
+
+}// namespace riginv
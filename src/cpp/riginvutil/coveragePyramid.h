@@ -0,0 +1,75 @@
+#ifndef __RIGINVUTIL_COVERAGE_PYRAMID_H
+#define __RIGINVUTIL_COVERAGE_PYRAMID_H
+
+#include <string>
+#include <vector>
+#include "coverageTrack.h"
+
+namespace riginv
+{
+
+/*! \brief Multi-resolution summary of the coverage of a reference
+ *
+ * Each level splits the reference into bins of a width (a multiple of the width of the level
+ * before), and holds the minimum, maximum and sum of the coverage of each bin. The last bin of a
+ * level is cut at the end of the reference.
+ *
+ * The coverage pyramid file is
+ *
+ *  * header: magic `RPYR`, version (uint8), reserved (uint8 * 3)
+ *  * the length of the reference (uint64), `min_cutoff`, `min_aln_len`, `min_mapping_quality`
+ *    (uint64 each) and `total_covered_length` (double)
+ *  * the number of levels (uint32), and for each level its bin width (uint64), the number of
+ *    bins `n` (uint64), the minimums (uint32 * n), maximums (uint32 * n) and sums (uint64 * n)
+ */
+class CoveragePyramid
+{
+public:
+    // the alignments the coverage is of (c.f. `concordant_aln_analysis`), so that a re-run can check them
+    ULL min_cutoff, min_aln_len, min_mapping_quality;
+    double total_covered_length;
+private:
+    ULL ref_len;
+    std::vector<ULL> widths;
+    std::vector<std::vector<unsigned int> > mins, maxs;
+    std::vector<std::vector<ULL> > sums;
+    ULL run_start;      // the run being added
+    unsigned int run_coverage;
+
+    unsigned int range_max(size_t level, size_t first, size_t last) const;
+public:
+    CoveragePyramid();
+
+    //! Start a pyramid of `ref_len` with the ascending `bin_widths`, each a multiple of the one before
+    void reset(ULL ref_len, const std::vector<ULL>& bin_widths);
+    //! The coverage from `start` on, in ascending order, as in CoverageTrackWriter::add()
+    void add(ULL start, unsigned int cvg);
+    //! The last run is to the end of the reference
+    void finish();
+    void save(const std::string& fname) const;
+    void load(const std::string& fname);
+
+    ULL reference_length() const;
+    size_t n_levels() const;
+    ULL bin_width(size_t level) const;
+    size_t n_bins(size_t level) const;
+    unsigned int bin_min(size_t level, size_t bin) const;
+    unsigned int bin_max(size_t level, size_t bin) const;
+    double bin_mean(size_t level, size_t bin) const;
+
+    /*! \brief Bounds of the maximum coverage over [first, last)
+     *
+     * `lower` is the maximum over [inner_first, inner_last), the bins of the finest level inside
+     * [first, last), and `upper` is that over the bins overlapping [first, last). The maximum over
+     * [first, inner_first) and [inner_last, last) is only known to be at most `upper`.
+     */
+    void max_bounds(ULL first, ULL last, unsigned int& lower, unsigned int& upper,
+            ULL& inner_first, ULL& inner_last) const;
+};
+
+const char COVERAGE_PYRAMID_MAGIC[] = "RPYR";
+const unsigned char COVERAGE_PYRAMID_VERSION = 1;
+
+}// namespace riginv
+
+#endif
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cstring>
+#include <loonutil/util.h>
+#include "coverageTrack.h"
+
+namespace riginv
+{
+
+/*======================= class CoverageTrackWriter =======================*/
+
+CoverageTrackWriter::CoverageTrackWriter():
+        offset(0), last_coverage(0), is_open(false)
+{}
+
+CoverageTrackWriter::CoverageTrackWriter(const std::string& fname):
+        offset(0), last_coverage(0), is_open(false)
+{
+    open(fname);
+}
+
+CoverageTrackWriter::~CoverageTrackWriter()
+{
+    if(is_open) close();
+}
+
+void CoverageTrackWriter::open(const std::string& fname)
+{
+    bin_out.open(fname);
+    bin_out.write_bytes(COVERAGE_TRACK_MAGIC, 4);
+    bin_out.write_uint8(COVERAGE_TRACK_VERSION);
+    const char reserved[3] = {0};
+    bin_out.write_bytes(reserved, 3);
+    bin_out.write_uint32(COVERAGE_TRACK_BLOCK_CAPACITY);
+    starts.clear();
+    coverage.clear();
+    index_starts.clear();
+    index_offsets.clear();
+    offset = 12;
+    last_coverage = 0;
+    is_open = true;
+}
+
+bool CoverageTrackWriter::opened() const
+{
+    return is_open;
+}
+
+void CoverageTrackWriter::flush_block()
+{
+    if(starts.empty())  return;
+    index_starts.push_back( starts.front() );
+    index_offsets.push_back( offset );
+    bin_out.write_uint32( static_cast<unsigned int>(starts.size()) );
+    bin_out.write_uint64( starts );
+    bin_out.write_uint32( coverage );
+    offset += 4 + starts.size() * 12;
+    starts.clear();
+    coverage.clear();
+}
+
+void CoverageTrackWriter::add(ULL start, unsigned int cvg)
+{
+    if(cvg == last_coverage)
+        return;
+    if(starts.size() >= COVERAGE_TRACK_BLOCK_CAPACITY)
+        flush_block();
+    starts.push_back( start );
+    coverage.push_back( cvg );
+    last_coverage = cvg;
+}
+
+void CoverageTrackWriter::close()
+{
+    flush_block();
+    bin_out.write_uint64( index_starts.size() );
+    bin_out.write_uint64( index_starts );
+    bin_out.write_uint64( index_offsets );
+    bin_out.write_uint64( offset );
+    bin_out.close();
+    is_open = false;
+}
+
+/*======================= class CoverageTrackReader =======================*/
+
+CoverageTrackReader::CoverageTrackReader(const std::string& fname):
+        bin_in(fname), cached_block(-1)
+{
+    char header[12];
+    bin_in.read_bytes(header, 12);
+    if(!bin_in.good() || memcmp(header, COVERAGE_TRACK_MAGIC, 4) != 0
+            || static_cast<unsigned char>(header[4]) != COVERAGE_TRACK_VERSION)
+        throw loon::Exception(5, "Unsupported coverage track file [%s]", fname.c_str());
+    bin_in.seek(bin_in.file_size() - 8);
+    bin_in.seek( bin_in.read_uint64() );
+    size_t k = bin_in.read_uint64();
+    bin_in.read_uint64(index_starts, k);
+    bin_in.read_uint64(index_offsets, k);
+    if(!bin_in.good())
+        throw loon::Exception(8, "Corrupted index in coverage track file [%s]", fname.c_str());
+}
+
+size_t CoverageTrackReader::n_blocks() const
+{
+    return index_starts.size();
+}
+
+void CoverageTrackReader::load_block(size_t block)
+{
+    if(block == cached_block)   return;
+    bin_in.seek( index_offsets[block] );
+    unsigned int n = bin_in.read_uint32();
+    bin_in.read_uint64(starts, n);
+    bin_in.read_uint32(coverage, n);
+    if(!bin_in.good())
+        throw loon::Exception(8, "Corrupted block in coverage track file");
+    cached_block = block;
+}
+
+unsigned int CoverageTrackReader::depth(ULL pos)
+{
+    // the last block starting at or before `pos`
+    size_t block = std::upper_bound(index_starts.begin(), index_starts.end(), pos) - index_starts.begin();
+    if(block == 0)
+        return 0;
+    load_block(block - 1);
+    size_t run = std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin();
+    return coverage[run - 1];
+}
+
+unsigned int CoverageTrackReader::max_depth(ULL first, ULL last)
+{
+    if(first >= last)
+        return 0;
+    unsigned int m = depth(first);
+    // the runs starting in (first, last), from the block of `first` on
+    size_t block = std::upper_bound(index_starts.begin(), index_starts.end(), first) - index_starts.begin();
+    if(block > 0)
+    {
+        size_t run = std::upper_bound(starts.begin(), starts.end(), first) - starts.begin();
+        for(; run < starts.size() && starts[run] < last; ++run)
+            m = std::max(m, coverage[run]);
+        if(run < starts.size())
+            return m;
+    }
+    for(; block < index_starts.size() && index_starts[block] < last; ++block)
+    {
+        load_block(block);
+        for(size_t run = 0; run < starts.size() && starts[run] < last; ++run)
+            m = std::max(m, coverage[run]);
+    }
+    return m;
+}
+
+}// namespace riginv
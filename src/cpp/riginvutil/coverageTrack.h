@@ -0,0 +1,84 @@
+#ifndef __RIGINVUTIL_COVERAGE_TRACK_H
+#define __RIGINVUTIL_COVERAGE_TRACK_H
+
+#include <string>
+#include <vector>
+#include <loonutil/iobin.h>
+
+namespace riginv
+{
+
+typedef unsigned long long ULL;
+
+/*! \brief Run-length encoded coverage of a reference
+ *
+ * The coverage track file is
+ *
+ *  * header: magic `RCVG`, version (uint8), reserved (uint8 * 3), block capacity (uint32)
+ *  * blocks, each of which is the number of runs `n` (uint32) followed by the columns
+ *    `start` (uint64 * n) and `coverage` (uint32 * n)
+ *  * the index: the number of blocks `k` (uint64), the `start` of the first run of each
+ *    block (uint64 * k) and the offset of each block (uint64 * k)
+ *  * footer: offset of the index (uint64)
+ *
+ * A run is the coverage from its `start` to the `start` of the next run. The coverage before
+ * the first run is 0, and two consecutive runs never have the same coverage.
+ *
+ * All the integers are in the byte order of the machine, as in loon::BinWriter.
+ */
+const char COVERAGE_TRACK_MAGIC[] = "RCVG";
+const unsigned char COVERAGE_TRACK_VERSION = 1;
+const unsigned int COVERAGE_TRACK_BLOCK_CAPACITY = 4096;
+
+/*! \brief Writer of a coverage track
+ *
+ * The coverage is given at the positions where it may change, in strictly ascending order.
+ * At most one block of runs is held in memory.
+ */
+class CoverageTrackWriter
+{
+private:
+    loon::BinWriter bin_out;
+    std::vector<ULL> starts;
+    std::vector<unsigned int> coverage;
+    std::vector<ULL> index_starts, index_offsets;
+    ULL offset;         // bytes written so far
+    unsigned int last_coverage;
+    bool is_open;
+
+    void flush_block();
+public:
+    CoverageTrackWriter();
+    explicit CoverageTrackWriter(const std::string& fname);
+    ~CoverageTrackWriter();
+    void open(const std::string& fname);
+    bool opened() const;
+    void add(ULL start, unsigned int cvg);     //!< the coverage from `start` on
+    void close();
+};
+
+/*! \brief Lookup of the coverage in a coverage track
+ *
+ * The index is loaded when the file is opened, and one block at a time afterwards,
+ * so a lookup takes O(log n), and the lookups near the previous one read no block.
+ */
+class CoverageTrackReader
+{
+private:
+    loon::BinReader bin_in;
+    std::vector<ULL> index_starts, index_offsets;
+    std::vector<ULL> starts;
+    std::vector<unsigned int> coverage;
+    size_t cached_block;
+
+    void load_block(size_t block);
+public:
+    explicit CoverageTrackReader(const std::string& fname);
+    size_t n_blocks() const;
+    unsigned int depth(ULL pos);    //!< the coverage at `pos`
+    unsigned int max_depth(ULL first, ULL last);    //!< the maximum coverage over [first, last)
+};
+
+}// namespace riginv
+
+#endif
@@ -0,0 +1,112 @@
+#include <cstring>
+#include <zlib.h>
+#include <loonutil/exception.h>
+#include "paf.h"
+
+namespace riginv
+{
+
+/*======================= class PafRecord =======================*/
+
+// the column starting at `p`, which is moved to the next column. false if there is no more column
+static bool next_column(const char*& p, const char* end, const char*& column, size_t& len)
+{
+    if(p > end) return false;
+    const char* tab = static_cast<const char*>(memchr(p, '\t', end - p));
+    if(tab == NULL)
+        tab = end;
+    column = p;
+    len = tab - p;
+    p = tab + 1;
+    return true;
+}
+
+static bool parse_unsigned(const char* column, size_t len, unsigned long long& num)
+{
+    if(len == 0)    return false;
+    num = 0;
+    for(size_t i = 0; i < len; ++i)
+    {
+        unsigned int digit = static_cast<unsigned char>(column[i] - '0');
+        if(digit > 9)   return false;
+        num = num * 10 + digit;
+    }
+    return true;
+}
+
+void PafRecord::parse(const char* line, size_t len)
+{
+    if(len > 0 && line[len - 1] == '\r')
+        --len;
+    const char* p = line;
+    const char* end = line + len;
+    const char* columns[12];
+    size_t lens[12];
+    unsigned long long nums[12];
+    for(int i = 0; i < 12; ++i)
+    {
+        bool is_number = (i != 0 && i != 4 && i != 5);
+        if(!next_column(p, end, columns[i], lens[i]) || (is_number && !parse_unsigned(columns[i], lens[i], nums[i])))
+            throw loon::Exception(8, "Malformed PAF line [%s]", std::string(line, len).c_str());
+    }
+    qname = columns[0];
+    qname_len = lens[0];
+    qry_len = nums[1];
+    qry_start = nums[2];
+    qry_end = nums[3];
+    is_reverse = (lens[4] == 1 && columns[4][0] == '-');
+    tname = columns[5];
+    tname_len = lens[5];
+    ref_len = nums[6];
+    ref_start = nums[7];
+    ref_end = nums[8];
+    mapq = static_cast<unsigned int>(nums[11]);
+}
+
+bool PafRecord::is_mapped() const
+{
+    return !(tname_len == 1 && tname[0] == '*');
+}
+
+/*======================= class PafReader =======================*/
+
+PafReader::PafReader(const std::string& filename, size_t chunk_size/* = 4194304 */):
+        in(NULL), fname(filename), chunk_size(chunk_size)
+{
+    in = gzopen(fname.c_str(), "rb");   // a plain file is read as it is
+    if(in == NULL)
+        throw loon::Exception(1, "Cannot open file [%s]", fname.c_str());
+    gzbuffer(in, 1 << 20);
+}
+
+PafReader::~PafReader()
+{
+    if(in != NULL)
+        gzclose(in);
+}
+
+bool PafReader::next_chunk(std::string& chunk)
+{
+    chunk.swap( partial );
+    partial.clear();
+    while(true)
+    {
+        size_t old_size = chunk.size();
+        chunk.resize(old_size + chunk_size);
+        int n = gzread(in, &chunk[old_size], static_cast<unsigned int>(chunk_size));
+        if(n < 0)
+            throw loon::Exception(8, "Cannot read [%s]", fname.c_str());
+        chunk.resize(old_size + n);
+        if(n == 0)  // the last line may not end with '\n'
+            return !chunk.empty();
+        size_t last_newline = chunk.rfind('\n');
+        if(last_newline != std::string::npos && last_newline >= old_size)
+        {
+            partial.assign(chunk, last_newline + 1, std::string::npos);
+            chunk.resize(last_newline + 1);
+            return true;
+        }
+    }
+}
+
+}// namespace riginv
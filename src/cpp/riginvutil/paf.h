@@ -0,0 +1,55 @@
+#ifndef __RIGINVUTIL_PAF_H
+#define __RIGINVUTIL_PAF_H
+
+#include <string>
+
+struct gzFile_s;
+
+namespace riginv
+{
+
+/*! \brief A view of the first 12 columns of one line of a PAF file (e.g., the output of minimap2)
+ *
+ * `qname qry_len qry_start qry_end strand tname ref_len ref_start ref_end n_matches block_len mapq`,
+ * separated by tabs. The coordinates are 0-based and half-open, and the query coordinates are
+ * on the forward strand of the query. The line must outlive the view.
+ */
+class PafRecord
+{
+public:
+    const char* qname;
+    size_t qname_len;
+    unsigned long long qry_len, qry_start, qry_end;
+    bool is_reverse;        // strand `-`
+    const char* tname;      // `*` if the query is unmapped
+    size_t tname_len;
+    unsigned long long ref_len, ref_start, ref_end;
+    unsigned int mapq;
+public:
+    void parse(const char* line, size_t len);   //!< throws if the line has less than 12 columns
+    bool is_mapped() const;
+};
+
+/*! \brief Reader of the lines of a PAF file, which may be gzip compressed
+ *
+ * The lines are returned in chunks of about `chunk_size` bytes, each of which contains complete
+ * lines only, so the chunks can be parsed independently, e.g., by different threads.
+ */
+class PafReader
+{
+private:
+    gzFile_s* in;
+    std::string fname;
+    std::string partial;    // the incomplete last line of the previous read
+    size_t chunk_size;
+public:
+    PafReader(const std::string& filename, size_t chunk_size = 4194304);
+    ~PafReader();
+    PafReader(const PafReader&) = delete;
+    PafReader& operator=(const PafReader&) = delete;
+    bool next_chunk(std::string& chunk);
+};
+
+}// namespace riginv
+
+#endif
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <loonutil/util.h>
+#include <loonutil/iobin.h>
+#include "readSegmentMap.h"
+
+namespace riginv
+{
+
+ReadSegmentMap::ReadSegmentMap():
+        offsets(1, 0), global_ids(false)
+{}
+
+void ReadSegmentMap::build(std::vector<std::pair<unsigned int, unsigned int> >& read_segments, const BriefAlnReader& reader)
+{
+    std::sort(read_segments.begin(), read_segments.end());
+    read_segments.erase( std::unique(read_segments.begin(), read_segments.end()), read_segments.end() );
+    if(read_segments.size() > 0xFFFFFFFFu)
+        throw loon::Exception(6, "Too many read segments (%zu) for the read segment map", read_segments.size());
+
+    size_t n_input_reads = reader.n_reads();
+    read_ids.clear();
+    offsets.assign(1, 0);
+    entries.clear();
+    entries.reserve( read_segments.size() );
+    for(std::vector<std::pair<unsigned int, unsigned int> >::const_iterator it = read_segments.begin(); it != read_segments.end(); ++it)
+    {
+        if(it->first >= n_input_reads)
+            throw loon::Exception(6, "Read ID %u is out of the %zu reads of the input", it->first, n_input_reads);
+        if(read_ids.empty() || read_ids.back() != it->first)
+        {
+            read_ids.push_back( it->first );
+            offsets.push_back( offsets.back() );
+        }
+        ++offsets.back();
+        entries.push_back( it->second );
+    }
+
+    global_ids = reader.has_global_ids();
+    names.clear();
+    if(!global_ids)
+        for(size_t i = 0; i < read_ids.size(); ++i)
+            names.push_back( reader.read_name(read_ids[i]) );
+}
+
+void ReadSegmentMap::save(const std::string& fname) const
+{
+    loon::BinWriter bin_out(fname);
+    bin_out.write_bytes(READ_SEGMENT_MAP_MAGIC, 4);
+    bin_out.write_uint8(READ_SEGMENT_MAP_VERSION);
+    bin_out.write_uint8(global_ids ? READ_SEGMENT_MAP_GLOBAL_IDS : READ_SEGMENT_MAP_HAS_NAMES);
+    bin_out.write_uint16(0);
+    bin_out.write_uint32( static_cast<unsigned int>(n_reads()) );
+    bin_out.write_uint32( static_cast<unsigned int>(entries.size()) );
+    bin_out.write_uint32( read_ids );
+    bin_out.write_uint32( offsets );
+    bin_out.write_uint32( entries );
+    if(!global_ids)
+    {
+        for(size_t i = 0; i < names.size(); ++i)
+            bin_out.write_uint32( static_cast<unsigned int>(names[i].length()) );
+        for(size_t i = 0; i < names.size(); ++i)
+            bin_out.write_bytes(names[i].data(), names[i].length());
+    }
+    bin_out.close();
+}
+
+void ReadSegmentMap::load(const std::string& fname)
+{
+    loon::BinReader bin_in(fname);
+    char header[8];
+    bin_in.read_bytes(header, 8);
+    if(!bin_in.good() || memcmp(header, READ_SEGMENT_MAP_MAGIC, 4) != 0
+            || static_cast<unsigned char>(header[4]) != READ_SEGMENT_MAP_VERSION)
+        throw loon::Exception(5, "Unsupported read segment map file [%s]", fname.c_str());
+    global_ids = (static_cast<unsigned char>(header[5]) & READ_SEGMENT_MAP_GLOBAL_IDS) != 0;
+    unsigned int m = bin_in.read_uint32();
+    unsigned int k = bin_in.read_uint32();
+    bin_in.read_uint32(read_ids, m);
+    bin_in.read_uint32(offsets, static_cast<size_t>(m) + 1);
+    bin_in.read_uint32(entries, k);
+    names.clear();
+    if(static_cast<unsigned char>(header[5]) & READ_SEGMENT_MAP_HAS_NAMES)
+    {
+        std::vector<unsigned int> lengths;
+        bin_in.read_uint32(lengths, m);
+        names.resize(m);
+        for(unsigned int i = 0; i < m; ++i)
+            bin_in.read_string(names[i], lengths[i]);
+    }
+    if(!bin_in.good() || offsets.back() != k
+            || std::adjacent_find(read_ids.begin(), read_ids.end(), std::greater_equal<unsigned int>()) != read_ids.end())
+        throw loon::Exception(8, "Corrupted read segment map file [%s]", fname.c_str());
+}
+
+size_t ReadSegmentMap::find(unsigned int read_id) const
+{
+    std::vector<unsigned int>::const_iterator it = std::lower_bound(read_ids.begin(), read_ids.end(), read_id);
+    if(it == read_ids.end() || *it != read_id)
+        return read_ids.size();
+    return it - read_ids.begin();
+}
+
+size_t ReadSegmentMap::n_reads() const
+{
+    return read_ids.size();
+}
+
+unsigned int ReadSegmentMap::read_id(size_t i) const
+{
+    return read_ids[i];
+}
+
+bool ReadSegmentMap::has_global_ids() const
+{
+    return global_ids;
+}
+
+const std::string& ReadSegmentMap::read_name(unsigned int read_id) const
+{
+    size_t i = find(read_id);
+    if(i >= names.size())
+        throw loon::Exception(6, "Read ID %u has no name in the read segment map", read_id);
+    return names[i];
+}
+
+void ReadSegmentMap::segments(unsigned int read_id, const unsigned int*& first, const unsigned int*& last) const
+{
+    size_t i = find(read_id);
+    if(i == n_reads())
+    {
+        first = last = entries.data();
+        return;
+    }
+    first = entries.data() + offsets[i];
+    last = entries.data() + offsets[i + 1];
+}
+
+bool ReadSegmentMap::contains(unsigned int read_id, unsigned int segment) const
+{
+    const unsigned int* first;
+    const unsigned int* last;
+    segments(read_id, first, last);
+    return std::binary_search(first, last, segment);
+}
+
+}// namespace riginv
@@ -0,0 +1,67 @@
+#ifndef __RIGINVUTIL_READ_SEGMENT_MAP_H
+#define __RIGINVUTIL_READ_SEGMENT_MAP_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "briefAlignment.h"
+
+namespace riginv
+{
+
+/*! \brief Validated segments of the reads of a contig
+ *
+ * The read segment map file is
+ *
+ *  * header: magic `RSEG`, version (uint8), flags (uint8), reserved (uint16)
+ *  * the number of reads `m` (uint32) and the number of entries `k` (uint32)
+ *  * read IDs (uint32 * m): the reads with a validated segment, ascending
+ *  * offsets (uint32 * (m + 1)): the segments of the `i`-th read are the entries
+ *    [offsets[i], offsets[i + 1])
+ *  * entries (uint32 * k): the indices of the validated segments (the lines of the output of
+ *    `concordant_aln_analysis`), ascending and unique for each read
+ *  * the read names if `flags & HAS_NAMES`: their lengths (uint32 * m) and the concatenated names
+ *
+ * So the map only takes the reads of the contig with a validated segment, whatever their IDs.
+ * As in the binary brief alignment format, with `flags & GLOBAL_IDS`, the read IDs are those of
+ * the read dictionary of the run, and there are no names. Otherwise the read IDs are those of the
+ * input, and the names are those of the reads of the map.
+ */
+class ReadSegmentMap
+{
+private:
+    std::vector<unsigned int> read_ids;
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> entries;
+    std::vector<std::string> names;
+    bool global_ids;
+
+    size_t find(unsigned int read_id) const;    // the index of `read_id` in the map, or n_reads()
+public:
+    ReadSegmentMap();
+
+    /*! \brief Build the map from (read ID, segment index) pairs of the reads of `reader`
+     *
+     * `read_segments` is sorted in place.
+     */
+    void build(std::vector<std::pair<unsigned int, unsigned int> >& read_segments, const BriefAlnReader& reader);
+    void save(const std::string& fname) const;
+    void load(const std::string& fname);
+
+    size_t n_reads() const;     //!< number of the reads with a validated segment
+    unsigned int read_id(size_t i) const;   //!< of the `i`-th read of the map, ascending
+    bool has_global_ids() const;
+    const std::string& read_name(unsigned int read_id) const;   //!< only without global IDs
+    //! The segments of `read_id` are [first, last), found by binary search. Empty for the reads without a validated segment
+    void segments(unsigned int read_id, const unsigned int*& first, const unsigned int*& last) const;
+    bool contains(unsigned int read_id, unsigned int segment) const;
+};
+
+const char READ_SEGMENT_MAP_MAGIC[] = "RSEG";
+const unsigned char READ_SEGMENT_MAP_VERSION = 2;
+const unsigned char READ_SEGMENT_MAP_HAS_NAMES = 1;
+const unsigned char READ_SEGMENT_MAP_GLOBAL_IDS = 2;
+
+}// namespace riginv
+
+#endif
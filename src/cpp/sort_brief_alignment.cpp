@@ -3,19 +3,49 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <memory>
+#include <functional>
+#include <deque>
+#include <future>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <sys/stat.h>
 
+#include <loonutil/util.h>
 #include <loonutil/simpleHelp.h>
+#include <loonutil/mappedTextReader.h>
+#include <loonutil/numFormat.h>
+#include <loonutil/loserTree.h>
+#include <loonutil/threadPool.h>
+#include <loonutil/parallelSort.h>
+#include <riginvutil/briefAlignment.h>
 
 using namespace std;
 
 typedef unsigned long long ULL;
 
+/*==================== command line args ====================*/
+size_t mem_limit = 0;       // sort in runs of at most this number of bytes, which are spilled to the disk and merged. 0 for no limit
+size_t n_threads = 1;
+bool binary_output = false;
+bool compress_output = false;
+string read_dict;
+
+/*==================== global variables ====================*/
+const size_t max_merge_runs = 256;  // maximum number of runs open at the same time
+const size_t min_text_run_buffer = 1u << 14;    // bytes read at once from a text run in the merge
+atomic<size_t> n_runs(0);   // number of runs created, for their file names
+
+// The remaining of the line points into the mapped input file, or the buffer of a run
 class BriefAln
 {
 public:
     ULL ref_start, ref_end;
-    string remaining;
+    const char* remaining;
+    size_t remaining_len;
 public:
     bool operator<(const BriefAln& rhs) const
     {
@@ -23,45 +53,534 @@ public:
         if(ref_start > rhs.ref_start)   return false;
         return ref_end > rhs.ref_end;
     }
-    friend ostream& operator<<(ostream& out, const BriefAln& obj);
-    friend istream& operator>>(istream& in, BriefAln& obj);
+    void append_to(string& out) const
+    {
+        loon::append_uint(out, ref_start);
+        out.push_back(' ');
+        loon::append_uint(out, ref_end);
+        out.append(remaining, remaining_len);
+        out.push_back('\n');
+    }
+};
+
+/*! A line of the input in the sort. The rest of the line is its offset from the start of
+ * the run, packed with its length in 64 bits, so that a record takes 24 bytes.
+ */
+class TextRecord
+{
+public:
+    static const int len_bits = 24;
+    static const ULL max_len = (1ULL << len_bits) - 1;
+    static const ULL max_offset = (1ULL << (64 - len_bits)) - 1;
+
+    ULL ref_start, ref_end;
+    ULL span;       // offset << len_bits | length
+public:
+    TextRecord() {}
+    TextRecord(const BriefAln& aln, const char* base):
+            ref_start(aln.ref_start), ref_end(aln.ref_end)
+    {
+        ULL offset = aln.remaining - base;
+        if(aln.remaining_len > max_len || offset > max_offset)
+            throw loon::Exception(6, "Line of %zu bytes at offset %llu is out of range for the sort", aln.remaining_len, offset);
+        span = (offset << len_bits) | aln.remaining_len;
+    }
+    // Equal alignments keep the order of the input, which is the order of their offsets
+    static bool in_input_order(const TextRecord& a, const TextRecord& b)
+    {
+        if(a.ref_start != b.ref_start)  return a.ref_start < b.ref_start;
+        if(a.ref_end != b.ref_end)      return a.ref_end > b.ref_end;
+        return a.span < b.span;
+    }
+    void append_to(string& out, const char* base) const
+    {
+        loon::append_uint(out, ref_start);
+        out.push_back(' ');
+        loon::append_uint(out, ref_end);
+        out.append(base + (span >> len_bits), span & max_len);
+        out.push_back('\n');
+    }
+};
+
+// Compare the heads of the runs in the k-way merge
+template<class Aln>
+class HeadLess
+{
+private:
+    const vector<Aln>* heads;
+public:
+    explicit HeadLess(const vector<Aln>& heads): heads(&heads) {}
+    bool operator()(size_t a, size_t b) const
+    {
+        return (*heads)[a] < (*heads)[b];
+    }
 };
 
-ostream& operator<<(ostream& out, const BriefAln& obj)
+// Grow the records of a run by doubling, but never beyond `max_records`, which is reached exactly
+template<class Aln>
+void push_to_run(vector<Aln>& alns, const Aln& aln, size_t max_records)
+{
+    if(alns.size() == alns.capacity())
+        alns.reserve( min(max_records, max<size_t>(alns.capacity() << 1, 1024)) );
+    alns.push_back( aln );
+}
+
+string new_run_fname(const char* outfile)
+{
+    return string(outfile) + ".run" + to_string(n_runs++);
+}
+
+// Sort by the tasks of `pool`, or by the calling thread without it
+template<class T, class Compare>
+void sort_run(vector<T>& alns, Compare comp, loon::ThreadPool* pool, bool stable)
 {
-    return out << obj.ref_start << ' ' << obj.ref_end << obj.remaining;
+    if(pool != NULL)
+        loon::parallel_sort(alns, comp, *pool, stable);
+    else if(stable)
+        stable_sort(alns.begin(), alns.end(), comp);
+    else
+        sort(alns.begin(), alns.end(), comp);
 }
 
-istream& operator>>(istream& in, BriefAln& obj)
+// Merge the groups of `fan_in` consecutive runs into longer runs, until they can be merged
+// at once. Equal alignments keep the order of the input, as the runs are merged in order.
+void reduce_runs(vector<string>& runs, const char* outfile, size_t fan_in, const function<void(const vector<string>&, const string&)>& merge)
 {
-    if(in >> obj.ref_start)
+    while(runs.size() > fan_in)
     {
-        in >> obj.ref_end;
-        getline(in, obj.remaining);
+        vector<string> merged;
+        for(size_t i = 0; i < runs.size(); i += fan_in)
+        {
+            vector<string> group(runs.begin() + i, runs.begin() + min(runs.size(), i + fan_in));
+            merged.push_back( new_run_fname(outfile) );
+            merge(group, merged.back());
+        }
+        runs.swap( merged );
     }
-    return in;
 }
 
-int main(int argc, char* argv[])
+/*==================== text format ====================*/
+
+bool read_text(loon::MappedTextReader& fin, BriefAln& aln)
+{
+    if(!fin.read_unsigned(aln.ref_start))
+        return false;
+    fin.read_unsigned(aln.ref_end);
+    if(!fin.read_line(aln.remaining, aln.remaining_len))
+        aln.remaining_len = 0;
+    return true;
+}
+
+// The blocks of lines are formatted by `pool` (or by this thread without it), and written
+// in order by this thread. The rest of the lines are at the offsets from `base`
+void write_text(const vector<TextRecord>& alns, const char* base, const string& outfile, loon::ThreadPool* pool)
+{
+    const size_t block_size = 16384;
+    const size_t max_inflight = pool == NULL ? 0 : pool->size() << 1;
+    ofstream fout;
+    loon::open_file(fout, outfile);
+    deque<pair<shared_ptr<string>, future<void> > > inflight;
+    string buffer;
+    for(size_t start = 0; start < alns.size() || !inflight.empty(); )
+    {
+        if(pool == NULL)
+        {
+            const TextRecord* first = alns.data() + start;
+            const TextRecord* last = alns.data() + min(alns.size(), start + block_size);
+            buffer.clear();
+            for(const TextRecord* it = first; it != last; ++it)
+                it->append_to(buffer, base);
+            fout.write(buffer.data(), buffer.size());
+            start += block_size;
+            continue;
+        }
+        if(start < alns.size() && inflight.size() < max_inflight)
+        {
+            shared_ptr<string> block = make_shared<string>();
+            const TextRecord* first = alns.data() + start;
+            const TextRecord* last = alns.data() + min(alns.size(), start + block_size);
+            inflight.push_back( make_pair(block, pool->submit( [block, first, last, base](){
+                            for(const TextRecord* it = first; it != last; ++it)
+                                it->append_to(*block, base);
+                        } )) );
+            start += block_size;
+            continue;
+        }
+        inflight.front().second.get();
+        fout.write(inflight.front().first->data(), inflight.front().first->size());
+        inflight.pop_front();
+    }
+    fout.close();
+}
+
+// Reader of a run of the text format, which is written by write_text(), through a buffer.
+// The runs are read rather than mapped, so that the memory taken by each of them is bounded.
+class TextRun
 {
-    loon::SimpleHelp help("sort_brief_alignment <required parameter>");
+private:
+    FILE* fp;
+    string buffer;
+    size_t pos, len;        // unread bytes of `buffer`
+    size_t buffer_size;
+public:
+    TextRun(const string& fname, size_t buffer_size);
+    ~TextRun();
+    bool next(BriefAln& aln);   //!< `aln.remaining` points into the buffer until the next call
+};
+
+TextRun::TextRun(const string& fname, size_t buffer_size):
+        fp(NULL), pos(0), len(0), buffer_size(buffer_size)
+{
+    fp = fopen(fname.c_str(), "rb");
+    if(fp == NULL)
+        throw loon::Exception(1, "Cannot open file [%s]", fname.c_str());
+}
 
-    help.add_argument("Input file of unsorted brief alignments");
-    help.add_argument("Output file of sorted brief alignments");
+TextRun::~TextRun()
+{
+    if(fp != NULL)
+        fclose(fp);
+}
 
-    help.check(argc, argv);
+bool TextRun::next(BriefAln& aln)
+{
+    const char* newline;
+    while((newline = static_cast<const char*>(memchr(buffer.data() + pos, '\n', len - pos))) == NULL)
+    {
+        buffer.erase(0, pos);
+        len -= pos;
+        pos = 0;
+        buffer.resize( max(buffer_size, len << 1) );    // a line longer than the buffer doubles it
+        size_t n = fread(&buffer[len], 1, buffer.size() - len, fp);
+        if(n == 0)
+            return false;   // the runs end with '\n'
+        len += n;
+    }
+    const char* p = buffer.data() + pos;
+    aln.ref_start = 0;
+    for(; *p != ' '; ++p)
+        aln.ref_start = aln.ref_start * 10 + (*p - '0');
+    aln.ref_end = 0;
+    for(++p; *p >= '0' && *p <= '9'; ++p)
+        aln.ref_end = aln.ref_end * 10 + (*p - '0');
+    aln.remaining = p;
+    aln.remaining_len = newline - p;
+    pos = newline + 1 - buffer.data();
+    return true;
+}
+
+// Number of the text runs merged at once with `limit`, so that their buffers of at least
+// `min_text_run_buffer` bytes take at most half of it
+size_t text_fan_in(size_t limit)
+{
+    return min(max<size_t>((limit >> 1) / min_text_run_buffer, 2), max_merge_runs);
+}
+
+// The runs are text files of the sorted lines, in the order of the input file
+void merge_text_runs(const vector<string>& runs, const string& outfile, size_t limit)
+{
+    size_t k = runs.size();
+    size_t buffer_size = max<size_t>(limit / (k << 1), min_text_run_buffer);
+    size_t flush_size = min<size_t>(max<size_t>(limit >> 2, min_text_run_buffer), 1u << 20);
+    vector<unique_ptr<TextRun> > readers;
+    vector<BriefAln> heads(k);
+    vector<bool> is_empty(k);
+    for(size_t i = 0; i < k; ++i)
+    {
+        readers.push_back( unique_ptr<TextRun>(new TextRun(runs[i], buffer_size)) );
+        is_empty[i] = !readers[i]->next( heads[i] );
+    }
+    loon::LoserTree<HeadLess<BriefAln> > tree(k, HeadLess<BriefAln>(heads));
+    tree.init(is_empty);
+
+    ofstream fout;
+    loon::open_file(fout, outfile);
+    string buffer;
+    while(!tree.empty())
+    {
+        size_t r = tree.top();
+        heads[r].append_to(buffer);
+        if(buffer.size() >= flush_size)
+        {
+            fout.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+        if(readers[r]->next( heads[r] ))
+            tree.replay();
+        else
+            tree.finish();
+    }
+    fout.write(buffer.data(), buffer.size());
+    fout.close();
+    readers.clear();
+    for(vector<string>::const_iterator it = runs.begin(); it != runs.end(); ++it)
+        remove( it->c_str() );
+}
 
-    vector<BriefAln> alns;
+// With `limit`, half of it is for the records of a run, each of which is counted twice
+// for the buffer of the sort, and half for their lines mapped
+void sort_text(const char* infile, const char* outfile, loon::ThreadPool* pool, size_t limit)
+{
+    vector<TextRecord> alns;
     BriefAln tmp;
-    ifstream fin(argv[1]);
-    ofstream fout(argv[2]);
-    while(fin >> tmp)
-        alns.push_back( tmp );
+    loon::MappedTextReader fin(infile);
+    vector<string> runs;
+    size_t max_records = limit == 0 ? SIZE_MAX : max<size_t>(limit / (sizeof(TextRecord) << 2), 1);
+    const char* run_start = NULL;
+    while(read_text(fin, tmp))
+    {
+        if(alns.empty())
+            run_start = tmp.remaining;
+        push_to_run(alns, TextRecord(tmp, run_start), max_records);
+        if(limit > 0 && (alns.size() >= max_records || static_cast<size_t>(tmp.remaining - run_start) >= (limit >> 1)))
+        {
+            sort_run(alns, TextRecord::in_input_order, pool, false);
+            runs.push_back( new_run_fname(outfile) );
+            write_text(alns, run_start, runs.back(), pool);
+            alns.clear();
+            fin.release();
+        }
+    }
+
+    sort_run(alns, TextRecord::in_input_order, pool, false);
+    if(runs.empty())
+    {
+        write_text(alns, run_start, outfile, pool);
+        return;
+    }
+    if(!alns.empty())
+    {
+        runs.push_back( new_run_fname(outfile) );
+        write_text(alns, run_start, runs.back(), pool);
+    }
+    vector<TextRecord>().swap(alns);
     fin.close();
+    reduce_runs(runs, outfile, text_fan_in(limit), [limit](const vector<string>& group, const string& fname){
+                merge_text_runs(group, fname, limit);
+            });
+    merge_text_runs(runs, outfile, limit);
+}
 
-    sort(alns.begin(), alns.end());
-    for(vector<BriefAln>::const_iterator it = alns.begin(); it != alns.end(); ++it)
-        fout << (*it) << endl;
-    fout.close();
+/*==================== binary format ====================*/
+
+// Without `keep_ids`, the read names of `reader` are written
+void write_records(const vector<riginv::BriefAln>& alns, const riginv::BriefAlnReader& reader, riginv::BriefAlnWriter& writer, bool keep_ids)
+{
+    for(vector<riginv::BriefAln>::const_iterator it = alns.begin(); it != alns.end(); ++it)
+        if(keep_ids)
+            writer.write(*it);
+        else
+            writer.write(*it, reader.read_name( it->read_id ));
+}
+
+// Block capacity of the binary files written with `limit`, so that the blocks of the runs merged
+// at once take a small share of it
+size_t records_block_capacity(size_t limit)
+{
+    if(limit == 0)  return riginv::BRIEF_ALN_BLOCK_CAPACITY;
+    size_t capacity = limit / (max_merge_runs * riginv::BriefAlnBlock::encoded_size(1) << 2);
+    return min<size_t>(max<size_t>(capacity, 256), riginv::BRIEF_ALN_BLOCK_CAPACITY);
+}
+
+/*! Number of the runs merged at once with `limit`, of which the read names take `names_memory`.
+ * Half of the rest is for the readers of the runs, each of which holds a block decoded and its
+ * bytes, and half for the block and the buffer of the writer.
+ */
+size_t records_fan_in(size_t limit, size_t names_memory)
+{
+    if(limit == 0)  return max_merge_runs;
+    size_t reader_memory = (riginv::BriefAlnBlock::encoded_size( records_block_capacity(limit) ) << 1) + 8192;
+    size_t available = max(limit > names_memory ? limit - names_memory : 0, limit >> 2);
+    return min(max<size_t>((available >> 1) / reader_memory, 2), max_merge_runs);
+}
+
+// The runs are binary files with the read IDs of `names`, and the read names are written
+// from `names` unless `keep_ids`
+void merge_record_runs(const vector<string>& runs, const string& outfile, bool binary, bool keep_ids, bool compress,
+        const riginv::BriefAlnReader& names, size_t block_capacity)
+{
+    size_t k = runs.size();
+    vector<unique_ptr<riginv::BriefAlnReader> > readers;
+    vector<riginv::BriefAln> heads(k);
+    vector<bool> is_empty(k);
+    for(size_t i = 0; i < k; ++i)
+    {
+        readers.push_back( unique_ptr<riginv::BriefAlnReader>(new riginv::BriefAlnReader(runs[i])) );
+        is_empty[i] = !readers[i]->next( heads[i] );
+    }
+    loon::LoserTree<HeadLess<riginv::BriefAln> > tree(k, HeadLess<riginv::BriefAln>(heads));
+    tree.init(is_empty);
+
+    riginv::BriefAlnWriter writer(outfile, binary, keep_ids, compress, block_capacity);
+    while(!tree.empty())
+    {
+        size_t r = tree.top();
+        if(keep_ids)
+            writer.write( heads[r] );
+        else
+            writer.write(heads[r], names.read_name( heads[r].read_id ));
+        if(readers[r]->next( heads[r] ))
+            tree.replay();
+        else
+            tree.finish();
+    }
+    writer.close();
+    readers.clear();
+    for(vector<string>::const_iterator it = runs.begin(); it != runs.end(); ++it)
+        remove( it->c_str() );
+}
+
+/*! Either the input or the output is in the binary format.
+ * Read IDs of the run are kept for the binary output. Otherwise, the read names are written.
+ * The runs are written with the read IDs of `reader` (c.f. BRIEF_ALN_GLOBAL_IDS), so the read names
+ * are only held by `reader`, and the runs are merged without them.
+ * With `limit`, the read names held are counted, and each record of a run is counted twice, for
+ * the buffer of the sort. The read names are kept, so they take at most 3/4 of `limit` for the runs.
+ */
+void sort_records(const char* infile, const char* outfile, loon::ThreadPool* pool, size_t limit)
+{
+    vector<riginv::BriefAln> alns;
+    riginv::BriefAln tmp;
+    riginv::BriefAlnReader reader(infile);
+    bool keep_ids = binary_output && reader.has_global_ids();
+    if(reader.has_global_ids() && !keep_ids)
+    {
+        if(read_dict.empty())
+            throw loon::Exception(5, "The read dictionary (--read-dict) is required for [%s]", infile);
+        reader.load_read_dict( read_dict );
+    }
+    vector<string> runs;
+    const size_t record_memory = sizeof(riginv::BriefAln) << 1;
+    size_t max_records = limit == 0 ? SIZE_MAX : max<size_t>(limit / record_memory, 1);
+    size_t block_capacity = records_block_capacity(limit);
+    while(reader.next( tmp ))
+    {
+        push_to_run(alns, tmp, max_records);
+        if(limit > 0 && alns.size() * record_memory + min(reader.read_names_memory(), limit / 4 * 3) >= limit)
+        {
+            sort_run(alns, less<riginv::BriefAln>(), pool, true);
+            runs.push_back( new_run_fname(outfile) );
+            riginv::BriefAlnWriter run_writer(runs.back(), true, true, false, block_capacity);
+            write_records(alns, reader, run_writer, true);
+            run_writer.close();
+            alns.clear();
+            reader.release();
+        }
+    }
+
+    sort_run(alns, less<riginv::BriefAln>(), pool, true);
+    if(runs.empty())
+    {
+        riginv::BriefAlnWriter writer(outfile, binary_output, keep_ids, compress_output, block_capacity);
+        write_records(alns, reader, writer, keep_ids);
+        writer.close();
+        return;
+    }
+    if(!alns.empty())
+    {
+        runs.push_back( new_run_fname(outfile) );
+        riginv::BriefAlnWriter run_writer(runs.back(), true, true, false, block_capacity);
+        write_records(alns, reader, run_writer, true);
+        run_writer.close();
+    }
+    vector<riginv::BriefAln>().swap(alns);
+    reader.release();
+    size_t fan_in = records_fan_in(limit, reader.read_names_memory());
+    reduce_runs(runs, outfile, fan_in, [&reader, block_capacity](const vector<string>& group, const string& fname){
+                merge_record_runs(group, fname, true, true, false, reader, block_capacity);
+            });
+    merge_record_runs(runs, outfile, binary_output, keep_ids, compress_output, reader, block_capacity);
+}
+
+// Sort `infile` by the tasks of `pool`, or by the calling thread without it
+void sort_file(const string& infile, const string& outfile, loon::ThreadPool* pool, size_t limit)
+{
+    if(!binary_output && !riginv::is_binary_brief_alignment(infile))
+        sort_text(infile.c_str(), outfile.c_str(), pool, limit);
+    else
+        sort_records(infile.c_str(), outfile.c_str(), pool, limit);
+}
+
+/*==================== batch ====================*/
+
+// The non-empty lines of `fname`
+vector<string> read_file_list(const char* fname)
+{
+    ifstream fin;
+    loon::open_file(fin, fname);
+    vector<string> ret;
+    string line;
+    while(getline(fin, line))
+        if(!line.empty())
+            ret.push_back( line );
+    return ret;
+}
+
+/*! The files of at least 1 / `pool.size()` of the total size are sorted one by one, each by all
+ * the threads. The others are sorted at the same time, each by one thread with its share of
+ * `mem_limit`. Both of them are sorted from the largest, so the small files fill in the end.
+ */
+void sort_batch(const char* input_list, const char* output_list, loon::ThreadPool& pool)
+{
+    vector<string> infiles = read_file_list(input_list);
+    vector<string> outfiles = read_file_list(output_list);
+    if(infiles.size() != outfiles.size())
+        throw loon::Exception(5, "[%s] lists %zu files, but [%s] lists %zu", input_list, infiles.size(), output_list, outfiles.size());
+
+    vector<size_t> sizes(infiles.size());
+    vector<size_t> order(infiles.size());
+    size_t total_size = 0;
+    for(size_t i = 0; i < infiles.size(); ++i)
+    {
+        struct stat st;
+        if(stat(infiles[i].c_str(), &st) != 0)
+            throw loon::Exception(1, "Cannot open file [%s]", infiles[i].c_str());
+        sizes[i] = st.st_size;
+        total_size += sizes[i];
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b){ return sizes[a] > sizes[b]; });
+
+    size_t i = 0;
+    for(; i < order.size() && sizes[ order[i] ] * pool.size() >= total_size; ++i)
+        sort_file(infiles[ order[i] ], outfiles[ order[i] ], &pool, mem_limit);
+
+    size_t limit = mem_limit == 0 ? 0 : max<size_t>(mem_limit / pool.size(), 1);
+    vector<future<void> > done;
+    for(; i < order.size(); ++i)
+    {
+        const string& infile = infiles[ order[i] ];
+        const string& outfile = outfiles[ order[i] ];
+        done.push_back( pool.submit( [&infile, &outfile, limit](){ sort_file(infile, outfile, NULL, limit); } ) );
+    }
+    for(size_t k = 0; k < done.size(); ++k)
+        done[k].get();
+}
+
+int main(int argc, char* argv[])
+{
+    loon::SimpleHelp help("sort_brief_alignment [options] <required parameter>");
+
+    help.add_argument("Input file of unsorted brief alignments (text or binary), or with --batch, a file listing them one per line");
+    help.add_argument("Output file of sorted brief alignments, or with --batch, a file listing them in the same order");
+    help.add_flag("--binary", "Write the output in the binary brief alignment format");
+    help.add_flag("--compress", "With --binary, varint encode the blocks of the output");
+    help.add_flag("--batch", "Sort all the files listed by the arguments in one process");
+    help.add_option("--read-dict", "Read dictionary of a binary input with read IDs", "");
+    help.add_option("-t", "Number of threads to sort and format the alignments", "1");
+    help.add_option("--mem-limit", "Sort in runs of at most this number of bytes, which are spilled to <output>.run<k> and merged (0 for no limit)", "0");
+
+    help.check(argc, argv);
+
+    mem_limit = stoull( help.get_option("--mem-limit") );
+    n_threads = max<size_t>(stoull( help.get_option("-t") ), 1);
+    binary_output = help.is_set("--binary");
+    compress_output = binary_output && help.is_set("--compress");
+    read_dict = help.get_option("--read-dict");
+    loon::ThreadPool pool(n_threads);
+    if(help.is_set("--batch"))
+        sort_batch(argv[1], argv[2], pool);
+    else
+        sort_file(argv[1], argv[2], &pool, mem_limit);
     return 0;
 }
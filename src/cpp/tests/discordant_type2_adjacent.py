@@ -0,0 +1,112 @@
+#!/usr/bin/env python
+"""discordant_type2 --adjacent: the rectangles of a small fixture of F/R transitions, and on
+generated split reads, the rectangles with --adjacent are a part of those of all the pairs.
+
+Usage: discordant_type2_adjacent.py <discordant_type2>
+"""
+import collections
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# `min_quality min_extension ksi allowed_distance` of the fixture
+FIXTURE_PARAMS = ["0", "100", "10", "5000"]
+
+# r0: F F R along the read, r1: F R, r2: R F, r3: F R overlapping by 20 bases on the read
+FIXTURE = """\
+10000 11000 0 1000 r0 1000 3000 60 F
+11000 12000 1000 2000 r0 1000 3000 60 F
+13000 14000 0 1000 r0 1000 3000 60 R
+20000 21000 0 1000 r1 1000 2000 60 F
+22000 23000 0 1000 r1 1000 2000 60 R
+30000 31000 1000 2000 r2 1000 2000 60 R
+32000 33000 1000 2000 r2 1000 2000 60 F
+40000 41020 0 1020 r3 1020 2000 60 F
+42000 43000 0 1000 r3 1000 2000 60 R
+"""
+
+# the rectangles of the F/R transitions: r0 from its second F piece to R, r1, r2 (R to F) and r3
+FIXTURE_ADJACENT = """\
+11990 12010 13990 14010  [ 0
+20990 21010 22990 23010  [ 0
+29990 30010 31990 32010 ] 0
+40990 41030 42970 43010 [ -20
+"""
+
+# all the pairs also join the first F piece of r0 to its R piece, across the second F piece
+FIXTURE_ALL = "10990 12010 13990 15010  [ 1000\n" + FIXTURE_ADJACENT
+
+def write_split_reads(fname, seed, n_reads, max_pieces):
+    """Reads whose pieces walk along the read and the reference, flipping the orientation at random"""
+    random.seed(seed)
+    alns = []
+    for r in range(n_reads):
+        qlen = random.randint(2000, 30000)
+        qs = 0
+        rs = random.randint(0, 5000000)
+        rev = random.random() < 0.5
+        for _ in range(random.randint(1, max_pieces)):
+            qe = min(qlen, qs + random.randint(100, 4000))
+            if qe - qs < 20:
+                break
+            re = rs + (qe - qs) + random.randint(-20, 20)
+            q1, q2 = (qlen - qe, qlen - qs) if rev else (qs, qe)
+            alns.append((rs, re, q1, q2, "r%d" % r, re - rs, qlen, random.randint(0, 60), "R" if rev else "F"))
+            qs = max(0, qe + random.randint(-60, 200))
+            rs = max(0, re + random.randint(-3000, 3000))
+            if random.random() < 0.5:
+                rev = not rev
+            if qs >= qlen - 20:
+                break
+    alns.sort(key=lambda a: a[0])
+    with open(fname, "w") as fout:
+        for aln in alns:
+            fout.write(" ".join(map(str, aln)) + "\n")
+
+def run(type2_bin, infile, outfile, params, args=[]):
+    subprocess.check_call([type2_bin, infile, outfile] + params + args)
+    with open(outfile) as fin:
+        return fin.read()
+
+def main():
+    type2_bin = sys.argv[1]
+    work = tempfile.mkdtemp()
+    try:
+        def path(name):
+            return os.path.join(work, name)
+        failed = []
+
+        with open(path("fixture.txt"), "w") as fout:
+            fout.write(FIXTURE)
+        if run(type2_bin, path("fixture.txt"), path("out.txt"), FIXTURE_PARAMS) != FIXTURE_ALL:
+            failed.append("fixture")
+        if run(type2_bin, path("fixture.txt"), path("out.txt"), FIXTURE_PARAMS, ["--adjacent"]) != FIXTURE_ADJACENT:
+            failed.append("fixture --adjacent")
+
+        n_all = n_adjacent = 0
+        for seed in range(20):
+            write_split_reads(path("in.txt"), seed, 200, 20)
+            for params in (["0", "100", "0", "1000"], ["30", "50", "10", "300"], ["0", "0", "0", "0"]):
+                all_rects = run(type2_bin, path("in.txt"), path("out.txt"), params)
+                adjacent = run(type2_bin, path("in.txt"), path("out.txt"), params, ["--adjacent"])
+                threaded = run(type2_bin, path("in.txt"), path("out.txt"), params, ["--adjacent", "-t", "3"])
+                extra = collections.Counter(adjacent.splitlines()) - collections.Counter(all_rects.splitlines())
+                if extra or threaded != adjacent:
+                    failed.append("seed %d %s" % (seed, " ".join(params)))
+                n_all += all_rects.count("\n")
+                n_adjacent += adjacent.count("\n")
+        print("%d rectangles of all the pairs, %d with --adjacent" % (n_all, n_adjacent))
+        if n_adjacent == 0 or n_adjacent >= n_all:
+            failed.append("generated reads")
+        if failed:
+            print("FAILED: " + ", ".join(failed))
+            return 1
+        return 0
+    finally:
+        shutil.rmtree(work)
+
+if __name__ == "__main__":
+    sys.exit(main())
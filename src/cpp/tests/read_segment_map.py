@@ -0,0 +1,138 @@
+#!/usr/bin/env python
+"""concordant_aln_analysis --read-map: the read segment map of a contig only takes its own reads,
+even if their global read IDs are large (as for the contigs late in a BAM file), and it maps
+each of them to segments of the output.
+
+Usage: read_segment_map.py <concordant_aln_analysis>
+"""
+import os
+import random
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+
+REF_LEN = 200000
+
+def write_global_ids_alignments(fname, read_ids):
+    """A binary brief alignment file with global IDs (c.f. riginv::BriefAlnBlock), in one block,
+    of the alignments of `read_ids` tiling the reference, sorted by ref_start"""
+    random.seed(3)
+    alns = []
+    for read_id in read_ids:
+        for _ in range(3):
+            rs = random.randint(0, REF_LEN - 6000)
+            re = rs + random.randint(2000, 5000)
+            alns.append((rs, re, 0, re - rs, re - rs, read_id, 60, random.random() < 0.5))
+    alns.sort(key=lambda a: a[0])
+    n = len(alns)
+    bits = bytearray((n + 7) // 8)
+    for i, aln in enumerate(alns):
+        if aln[7]:
+            bits[i >> 3] |= 1 << (i & 7)
+    with open(fname, "wb") as fout:
+        fout.write(b"RBAL" + struct.pack("=BBHI", 1, 2, 0, 65536))
+        fout.write(struct.pack("=I", n))
+        fout.write(struct.pack("=%dQ" % n, *[a[0] for a in alns]))
+        fout.write(struct.pack("=%dQ" % n, *[a[1] for a in alns]))
+        for column in range(2, 6):
+            fout.write(struct.pack("=%dI" % n, *[a[column] for a in alns]))
+        fout.write(bytearray(a[6] for a in alns))
+        fout.write(bits)
+        fout.write(struct.pack("=I", 0))
+        names_offset = fout.tell()
+        fout.write(struct.pack("=IQ", max(read_ids) + 1, names_offset))
+
+def write_text_alignments(fname, n_reads):
+    """The text alignments of `n_reads` reads tiling the reference, of which only the first half
+    are long enough to be considered (c.f. the minimum length of main())"""
+    random.seed(4)
+    alns = []
+    for r in range(n_reads):
+        for _ in range(3):
+            rs = random.randint(0, REF_LEN - 6000)
+            re = rs + (random.randint(2000, 5000) if r < n_reads // 2 else 50)
+            alns.append((rs, re, 0, re - rs, "read%d" % r, re - rs, re - rs, 60, random.choice("FR")))
+    alns.sort(key=lambda a: a[0])
+    with open(fname, "w") as fout:
+        for aln in alns:
+            fout.write(" ".join(map(str, aln)) + "\n")
+
+def read_map(fname):
+    """(read IDs, offsets, entries, names) of a read segment map file"""
+    with open(fname, "rb") as fin:
+        data = fin.read()
+    if data[:4] != b"RSEG":
+        raise ValueError("not a read segment map: " + fname)
+    flags = struct.unpack_from("=B", data, 5)[0]
+    m, k = struct.unpack_from("=II", data, 8)
+    read_ids = struct.unpack_from("=%dI" % m, data, 16)
+    offsets = struct.unpack_from("=%dI" % (m + 1), data, 16 + 4 * m)
+    entries = struct.unpack_from("=%dI" % k, data, 20 + 8 * m)
+    pos = 20 + 8 * m + 4 * k
+    names = []
+    if flags & 1:
+        lengths = struct.unpack_from("=%dI" % m, data, pos)
+        pos += 4 * m
+        for length in lengths:
+            names.append(data[pos:pos + length].decode())
+            pos += length
+    if len(data) != pos:
+        raise ValueError("unexpected size of " + fname)
+    return read_ids, offsets, entries, names
+
+def check_map(fname, outfile, read_ids, max_size):
+    """The problems of the map `fname` of the output `outfile`, whose reads are some of `read_ids`,
+    and the names of the map"""
+    size = os.path.getsize(fname)
+    if size > max_size:
+        return ["size %d" % size], []
+    with open(outfile) as fin:
+        n_segments = len(fin.read().splitlines())
+    map_ids, offsets, entries, names = read_map(fname)
+    print("%d reads, %d entries, %d bytes" % (len(map_ids), len(entries), size))
+    problems = []
+    if not map_ids or not set(map_ids) <= set(read_ids) or list(map_ids) != sorted(set(map_ids)):
+        problems.append("read IDs")
+    if any(offsets[i] >= offsets[i + 1] for i in range(len(map_ids))) or any(e >= n_segments for e in entries):
+        problems.append("segments")
+    return problems, names
+
+def main():
+    analysis_bin = sys.argv[1]
+    work = tempfile.mkdtemp()
+    try:
+        def path(name):
+            return os.path.join(work, name)
+        def analyze(infile, outfile, mapfile):
+            subprocess.check_call([analysis_bin, "--read-map", path(mapfile), str(REF_LEN), "0", "10", "100", "0",
+                    path(infile), path(outfile), "0", "0"])
+        failed = []
+
+        # the reads of the contig have IDs in the millions, as after many other contigs
+        read_ids = sorted(random.Random(5).sample(range(8000000, 9000000), 40))
+        write_global_ids_alignments(path("in.bin"), read_ids)
+        analyze("in.bin", "out.txt", "map.bin")
+        problems, names = check_map(path("map.bin"), path("out.txt"), read_ids, 1024)
+        failed += ["global IDs: " + p for p in problems]
+        if names:
+            failed.append("global IDs: names")
+
+        # the names are those of the reads of the map, which are those with an alignment considered
+        write_text_alignments(path("in.txt"), 40)
+        analyze("in.txt", "out2.txt", "map2.bin")
+        problems, names = check_map(path("map2.bin"), path("out2.txt"), range(40), 1024)
+        failed += ["names: " + p for p in problems]
+        if not problems and sorted(names) != sorted("read%d" % r for r in range(20)):
+            failed.append("names")
+
+        if failed:
+            print("FAILED: " + ", ".join(failed))
+            return 1
+        return 0
+    finally:
+        shutil.rmtree(work)
+
+if __name__ == "__main__":
+    sys.exit(main())
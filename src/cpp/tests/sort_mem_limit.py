@@ -0,0 +1,70 @@
+#!/usr/bin/env python
+"""sort_brief_alignment --mem-limit: the output is the one of a sort without the limit, and the
+peak RSS stays within a few times the limit above that of the process sorting a tiny input.
+
+Usage: sort_mem_limit.py <sort_brief_alignment>
+"""
+import os
+import random
+import resource
+import shutil
+import subprocess
+import sys
+import tempfile
+
+def peak_rss_kb(cmd):
+    """Peak RSS of `cmd`, which is run in a child process of its own"""
+    script = "import resource, subprocess, sys\n" \
+             "subprocess.check_call(sys.argv[1:])\n" \
+             "print(resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss)\n"
+    return int(subprocess.check_output([sys.executable, "-c", script] + cmd).decode().split()[-1])
+
+def write_alignments(fname, n_alns, n_reads):
+    random.seed(11)
+    with open(fname, "w") as fout:
+        for _ in range(n_alns):
+            rs = random.randint(0, 50000000)
+            re = rs + random.randint(100, 20000)
+            qs = random.randint(0, 5000)
+            qe = qs + (re - rs)
+            fout.write("%d %d %d %d r%d %d %d %d %s\n" % (rs, re, qs, qe, random.randint(0, n_reads - 1),
+                    re - rs, qe + random.randint(0, 5000), random.randint(0, 60), random.choice("FR")))
+
+def main():
+    sort_bin = sys.argv[1]
+    work = tempfile.mkdtemp()
+    try:
+        def path(name):
+            return os.path.join(work, name)
+        write_alignments(path("in.txt"), 300000, 20000)
+        write_alignments(path("tiny.txt"), 10, 10)
+        base_rss = peak_rss_kb([sort_bin, "--binary", path("tiny.txt"), path("tiny.bin")])
+
+        subprocess.check_call([sort_bin, path("in.txt"), path("full.txt")])
+        failed = []
+        # with the small limit, the text runs are over 200, which are merged in several passes
+        for name, args, infile, limit in [("text", [], "in.txt", 2 << 20), ("text, many runs", [], "in.txt", 128 << 10),
+                ("text to binary", ["--binary"], "in.txt", 2 << 20),
+                ("binary", [], "full.bin", 2 << 20), ("binary to binary", ["--binary"], "full.bin", 2 << 20)]:
+            if infile == "full.bin" and not os.path.exists(path("full.bin")):
+                subprocess.check_call([sort_bin, "--binary", path("in.txt"), path("full.bin")])
+            out = path("out")
+            rss = peak_rss_kb([sort_bin, "--mem-limit", str(limit)] + args + [path(infile), out])
+            if "--binary" in args:
+                subprocess.check_call([sort_bin, out, out + ".txt"])
+                out += ".txt"
+            with open(out) as f1, open(path("full.txt")) as f2:
+                same = f1.read() == f2.read()
+            extra_kb = rss - base_rss
+            print("%s: %d KB above the base, the output is %s" % (name, extra_kb, "the same" if same else "DIFFERENT"))
+            if not same or extra_kb > 4 * (limit >> 10):
+                failed.append(name)
+        if failed:
+            print("FAILED: " + ", ".join(failed))
+            return 1
+        return 0
+    finally:
+        shutil.rmtree(work)
+
+if __name__ == "__main__":
+    sys.exit(main())
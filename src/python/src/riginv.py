@@ -10,16 +10,29 @@ import logging
 with open(os.path.join( os.path.dirname(os.path.abspath(os.path.realpath(__file__))), "version.txt" )) as f_version:
     __version__ = f_version.read().strip()
 
-all_steps = ["extract", "val_seg", "type2", "cluster2"]
+all_steps = ["extract", "val_seg", "type1", "type2", "cluster2"]
 all_steps_key = dict(zip(all_steps, range(len(all_steps))))
 
 boolTo01 = {True: "1", False: "0"}
 
+def dirty_fname(args):
+    return os.path.join(args.working_dir, "intermediate_results", "dirty.txt")
+
 def id_path_iter(args):
+    """Contigs of the working directory. With --append, only the contigs whose alignments
+    changed since their later steps were run (listed in dirty.txt by `bam_extract --append`)
+    """
+    dirty = None
+    if args.append:
+        dirty = set()
+        if os.path.exists(dirty_fname(args)):
+            with open(dirty_fname(args)) as fin:
+                dirty = set(fin.read().split())
     with open(os.path.join(args.working_dir, "intermediate_results", "spec.txt")) as fin:
         for line in fin:
             line = line.strip().split()
             if not line: continue
+            if dirty is not None and line[0] not in dirty: continue
             yield {"id": line[0], # ref_id, str()
                    "ref_name": line[1],
                    "ref_len": line[2], # str()
@@ -34,36 +47,76 @@ def part_id_path_iter(contig, analysis_type):
             yield {"part_id": line[0],
                    "part_id_path": line[1]}
 
+def aln_suffix(args, sorted_alns = True):
+    """Suffix of the file names of the (sorted) brief alignments. They are `<id>.bin` and
+    `<id>.sorted.bin` with --binary-alignments, and `<id>.txt` and `<id>.sorted.txt` otherwise
+    """
+    # bamExtractor.py only writes the text format. sort_brief_alignment converts it
+    ext = ".bin" if args.binary_alignments and (sorted_alns or not args.pysam_extractor) else ".txt"
+    return (".sorted" if sorted_alns else "") + ext
+
+def aln_fname(args, contig, sorted_alns = True):
+    """File name of the (sorted) brief alignments of a contig"""
+    return os.path.join(contig["id_path"], contig["id"] + aln_suffix(args, sorted_alns))
+
+def is_paf(fname):
+    return fname.endswith(".paf") or fname.endswith(".paf.gz")
+
 def run_extract_bam(args):
     """Extract bam file and sort it
     1. Extract the bam file
-        Input file: bam file
+        Input file: bam file (or PAF file, which is extracted by bam_extract --paf)
         Output files:
             <working_directory>
                 |- intermediate_results/
                     |- spec.txt
                     |- inc.mk
                     |- <id> paths ... /  (for each <id>)
-                        |- <id>.txt
+                        |- <id>.txt (or <id>.bin with --binary-alignments)
 
     2. Sort each <id>.txt as <id>.sorted.txt
         Input file:     each <id path>/<id>.txt
         Output file:    each <id path>/<id>.txt
+       bam_extract sorts the alignments itself, so this step is only for the pysam extractor
     """
 
-    sys.path.append(args.aux_dir)
-    import bamExtractor
-    # 1. Extract the bam file to the directory `<working_dir>/brief_alignments/`
+    # 1. Extract the bam file to the directory `<working_dir>/intermediate_results/`
     args.logger.info("Extract BAM")
-    bamExtractor.main(['-b', args.bam, "-d", args.working_dir, "-m", "--max-nfiles", str(args.max_nfiles), "--cache-size", str(args.cache_size)])
-
-    # 2. Sort each `<id>.txt` as `<id>.sorted.txt`
+    if args.pysam_extractor:
+        sys.path.append(args.aux_dir)
+        import bamExtractor
+        bamExtractor.main(['-b', args.bam, "-d", args.working_dir, "-m", "--max-nfiles", str(args.max_nfiles), "--cache-size", str(args.cache_size)])
+    else:
+        # extract the references in parallel if the BAM file is sorted and indexed
+        bam_index = [args.bam + ".bai", args.bam + ".csi", os.path.splitext(args.bam)[0] + ".bai"]
+        if is_paf(args.bam):
+            bam_index = []
+        subprocess.check_call([os.path.join(args.aux_dir, "bam_extract"),
+                    "-t", str(args.nproc), "-m", "--cache-size", str(args.cache_size), "--max-nfiles", str(args.max_nfiles),
+                    "--sort", "--sort-memory", str(args.sort_memory)]
+                    + (["--binary"] if args.binary_alignments else [])
+                    + (["--compress"] if args.compress_alignments else [])
+                    + (["--use-index"] if any(os.path.exists(f) for f in bam_index) else [])
+                    + (["--append"] if args.append else [])
+                    + (["--paf"] if is_paf(args.bam) else [])
+                    + [args.bam, args.working_dir])
+        return
+
+    # 2. Sort each `<id>.txt` as `<id>.sorted.txt`, all of them by one sort_brief_alignment --batch
     args.logger.info("Sort extracted BAM")
-    for contig in id_path_iter(args):
-        subprocess.check_call([os.path.join(args.aux_dir, "sort_brief_alignment"), 
-                    os.path.join( contig["id_path"],  contig["id"] + ".txt" ),
-                    os.path.join( contig["id_path"],  contig["id"] + ".sorted.txt")
-                ])
+    input_list = os.path.join(args.working_dir, "intermediate_results", "sort_inputs.txt")
+    output_list = os.path.join(args.working_dir, "intermediate_results", "sort_outputs.txt")
+    with open(input_list, "w") as inputs, open(output_list, "w") as outputs:
+        for contig in id_path_iter(args):
+            inputs.write(aln_fname(args, contig, False) + "\n")
+            outputs.write(aln_fname(args, contig) + "\n")
+    subprocess.check_call([os.path.join(args.aux_dir, "sort_brief_alignment"), "--batch"]
+                + (["--binary"] if args.binary_alignments else [])
+                + (["--compress"] if args.compress_alignments else [])
+                + ["--mem-limit", str(args.sort_memory), "-t", str(args.nproc)]
+                + [input_list, output_list])
+    os.remove(input_list)
+    os.remove(output_list)
     ## subprocess.check_call(["make", "-f", os.path.join(args.makefile_dir, "intermediate_results.make"),
     ##         "-j", args.nproc,
     ##         "INC_FNAME={}".format(os.path.join(args.working_dir, "intermediate_results", "inc.mk")),
@@ -75,16 +128,29 @@ def run_concordant_analysis(args):
     
     Input file:     each <id path>/<id>.sorted.txt
     Output file:    each <id path>/<id>.concordant.txt
+                    each <id path>/<id>.coverage.bin (with --ca-coverage-track or --ca-coverage-pyramid)
+                    each <id path>/<id>.pyramid.bin (with --ca-coverage-pyramid)
+                    each <id path>/<id>.segments.bin (with --ca-read-map)
+    With --ca-rerun, <id>.coverage.bin and <id>.pyramid.bin of an earlier run are read instead
     """
     args.logger.info("Concordant analysis")
-    for contig in id_path_iter(args):
-        subprocess.check_call([os.path.join(args.aux_dir, "concordant_aln_analysis"),
-                    contig["ref_len"], str(args.ca_min_cutoff), str(args.ca_min_overlap), 
-                    str(args.ca_min_length), str(args.min_quality),
-                    os.path.join(contig["id_path"], contig["id"] + ".sorted.txt"),
-                    os.path.join(contig["id_path"], contig["id"] + ".concordant.txt"),
-                    str(args.ca_min_coverage), str(args.ca_min_coverage_ratio)
-                ])
+    # all the contigs in one concordant_aln_analysis --batch, with the spec of the contigs to analyze
+    contig_spec = os.path.join(args.working_dir, "intermediate_results", "concordant_spec.txt")
+    with open(contig_spec, "w") as fout:
+        for contig in id_path_iter(args):
+            fout.write("{} {} {} {}\n".format(contig["id"], contig["ref_name"], contig["ref_len"], contig["id_path"]))
+    pyramid = args.ca_coverage_pyramid or args.ca_rerun
+    subprocess.check_call([os.path.join(args.aux_dir, "concordant_aln_analysis"), "--batch", "--stream", "-t", str(args.nproc)]
+                + (["--rerun"] if args.ca_rerun else [])
+                + (["--coverage", ".coverage.bin"] if args.ca_coverage_track or pyramid else [])
+                + (["--pyramid", ".pyramid.bin"] if pyramid else [])
+                + (["--read-map", ".segments.bin"] if args.ca_read_map else [])
+                + [contig_spec, str(args.ca_min_cutoff), str(args.ca_min_overlap),
+                str(args.ca_min_length), str(args.min_quality),
+                aln_suffix(args), ".concordant.txt",
+                str(args.ca_min_coverage), str(args.ca_min_coverage_ratio)
+            ])
+    os.remove(contig_spec)
 
 def run_discordant_type1(args):
     """Run discordant type1 analysis
@@ -95,7 +161,7 @@ def run_discordant_type1(args):
     args.logger.info("Find type 1 inversions")
     for contig in id_path_iter(args):
         subprocess.check_call([os.path.join(args.aux_dir, "discordant_type1"),
-                    os.path.join(contig["id_path"], contig["id"] + ".sorted.txt"),
+                    aln_fname(args, contig),
                     os.path.join(contig["id_path"], contig["id"] + ".type1.txt"),
                     str(args.t1_delta), str(args.t1_percent), str(args.min_quality), str(args.max_allowed_overlap)
                 ])
@@ -137,11 +203,12 @@ def run_discordant_type2(args):
             args.logger.info("    Analyze contig {}".format(contig["id"]))
             args.logger.info("        Find all type 2 rectangles")
             subprocess.check_call([os.path.join(args.aux_dir, "discordant_type2"),
-                        os.path.join(contig["id_path"], contig["id"] + ".sorted.txt"),
+                        aln_fname(args, contig),
                         os.path.join(contig["id_path"], contig["id"] + ".type2.txt"),
                         str(args.min_quality), str(args.t2_min_extension),
-                        str(args.t2_ksi), str(args.max_adj_distance)
-                    ])
+                        str(args.t2_ksi), str(args.max_adj_distance),
+                        "-t", str(args.t2_threads)
+                    ] + (["--adjacent"] if args.t2_adjacent else []))
         if "cluster2" in args.run_steps:
             # 2. Partition into connected components
             args.logger.info("        Partition into connected components")
@@ -192,12 +259,18 @@ def run(args):
     
     if "val_seg" in args.run_steps:
         run_concordant_analysis(args)
-    # run_discordant_type1(args) # not useful for now
+
+    if "type1" in args.run_steps:
+        run_discordant_type1(args)
 
     if "type2" in args.run_steps or "cluster2" in args.run_steps:
         run_discordant_type2(args)
     # run_discordant_type3(args) # not implemented yet
 
+    # the changed contigs are up to date after the last step
+    if args.append and "cluster2" in args.run_steps and os.path.exists(dirty_fname(args)):
+        os.remove(dirty_fname(args))
+
 def parse_args():
     parser = argparse.ArgumentParser(description = "RigInv: Rigorous Inversion Detection (Slow version)")
     parser.add_argument("--start-from", default="extract", choices = all_steps, help="Start from this chosen step. (default: %(default)s)")
@@ -206,9 +279,14 @@ def parse_args():
     parser.add_argument("-j", "--nproc", default=multiprocessing.cpu_count(), type=int, help="Number of processes (default: %(default)s)")
     parser.add_argument("--max-nfiles", default=512, type=int, help="Keep at most this number of files open (default: %(default)s)")
     parser.add_argument("--cache-size", default=1048576, type=int, help="Hold at most this number of bytes for each file before flushing to the disk (default: %(default)s)")
+    parser.add_argument("--sort-memory", default=1073741824, type=int, help="bam_extract (or sort_brief_alignment) spills the alignments being sorted to the disk when they take more than this number of bytes (default: %(default)s)")
 
     # extract
-    parser.add_argument("-b", "--bam", help="BAM/SAM file to be extracted. This is only used in the 'extract' step")
+    parser.add_argument("-b", "--bam", help="BAM/SAM file to be extracted, or PAF file (.paf or .paf.gz, e.g., the output of minimap2). This is only used in the 'extract' step")
+    parser.add_argument("--pysam-extractor", action="store_true", help="Extract the BAM file with the (slower) pysam based bamExtractor.py instead of bam_extract")
+    parser.add_argument("--binary-alignments", action="store_true", help="Save the brief alignments in the binary format (<id>.bin, <id>.sorted.bin), which is smaller and faster to parse")
+    parser.add_argument("--compress-alignments", action="store_true", help="With --binary-alignments, varint encode the brief alignments to save the scratch space")
+    parser.add_argument("--append", action="store_true", help="Merge the alignments of the BAM file into those already extracted to the working directory (from a BAM file of the same references), and rerun the later steps only for the contigs it changed")
     
     # for concordant analysis, and all discordant types analysis
     parser.add_argument("--min-quality", default=0, type=int, help="Minimum mapping quality in consideration (default: %(default)s)")
@@ -222,6 +300,10 @@ def parse_args():
     parser.add_argument("--ca-min-length", default=100, type=int, help="[concordant analysis]: Minimum length of an alignment in consideration (default: %(default)s)")
     parser.add_argument("--ca-min-coverage", default=10, type=int, help="[concordant analysis]: Minimum coverage for an alignment to be kept (default: %(default)s)")
     parser.add_argument("--ca-min-coverage-ratio", default=0.1, type=float, help="[concordant analysis]: Minimum coverage ratio for an alignment to be kept (default: %(default)s)")
+    parser.add_argument("--ca-coverage-track", action="store_true", help="[concordant analysis]: Also save the coverage of each contig as <id>.coverage.bin (c.f. riginv::CoverageTrackReader)")
+    parser.add_argument("--ca-coverage-pyramid", action="store_true", help="[concordant analysis]: Also save the coverage of each contig as <id>.coverage.bin, and its minimum, maximum and mean in bins of 1kb, 10kb and 100kb as <id>.pyramid.bin (c.f. riginv::CoveragePyramid), for --ca-rerun")
+    parser.add_argument("--ca-rerun", action="store_true", help="[concordant analysis]: Rerun with other --ca-min-coverage or --ca-min-coverage-ratio from the files saved by an earlier run with --ca-coverage-pyramid, instead of the sweep of the alignments")
+    parser.add_argument("--ca-read-map", action="store_true", help="[concordant analysis]: Also save the validated segments of each read as <id>.segments.bin (c.f. riginv::ReadSegmentMap)")
     
     # discordant type 1
     parser.add_argument("--t1-delta", default=100, type=int, help="[discordant type 1]: Maximum allowed difference between the inversions of REF and QRY (default: %(default)s)")
@@ -230,6 +312,8 @@ def parse_args():
     # discordant type 2
     parser.add_argument("--t2-ksi", default=10, type=int, help="[discordant type 2]: Allowed error for assessing break points (used for output breakpoints) (default: %(default)s)")
     parser.add_argument("--t2-min-extension", default=100, type=int, help="[discordant type 2]: Minimum required non-overlapping length when two split reads overlap w.r.t. their input sequence (default: %(default)s)")
+    parser.add_argument("--t2-adjacent", action="store_true", help="[discordant type 2]: Only pair the forward and reverse alignments next to each other on a read, instead of all of them")
+    parser.add_argument("--t2-threads", default=1, type=int, help="[discordant type 2]: Number of threads to analyze the reads of a contig (default: %(default)s)")
 
     # refine type 2
     parser.add_argument("--t2-no-refine", action="store_true", help="Don't refine type 2 predictions.")
@@ -257,6 +341,10 @@ def parse_args():
 
 def main():
     args = parse_args()
+    if args.append and args.pysam_extractor:
+        sys.exit("--append is not supported by --pysam-extractor")
+    if args.bam and is_paf(args.bam) and args.pysam_extractor:
+        sys.exit("PAF files are not supported by --pysam-extractor")
     
     
     if args.steps: